@@ -0,0 +1,109 @@
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 500
+#endif /* _XOPEN_SOURCE */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+
+/* A simple region allocator. All memory belonging to one generation
+ * of the configuration (bindings, keys, names and arguments) is taken
+ * from one arena, so that the whole tree can be released at once by
+ * arena_free() instead of freeing each node individually. */
+
+Arena_t* arena_new() {
+  Arena_t *self = (Arena_t *) calloc(1, sizeof(Arena_t));
+
+  self->blocks = NULL;
+  self->num_allocs = 0;
+  self->num_blocks = 0;
+  self->bytes_used = 0;
+  self->bytes_reserved = 0;
+
+  return self;
+}
+
+void *arena_alloc(Arena_t *self, size_t size) {
+  ArenaBlock_t *block = self->blocks;
+  size_t block_size;
+  void *ptr;
+
+  size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+  if(block == NULL || block->size - block->used < size) {
+
+    /* start a new block, oversized requests get a block of their own */
+    block_size = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+
+    block = (ArenaBlock_t *) calloc(1, sizeof(ArenaBlock_t));
+    block->data = (char *) calloc(block_size, sizeof(char));
+
+    if(block->data == NULL) {
+      fprintf(stderr, "%s: error: out of memory\n", PACKAGE_NAME);
+      fflush(stderr);
+      exit(EXIT_FAILURE);
+    }
+
+    block->size = block_size;
+    block->used = 0;
+    block->next = self->blocks;
+    self->blocks = block;
+
+    self->num_blocks++;
+    self->bytes_reserved += block_size;
+  }
+
+  ptr = block->data + block->used;
+  block->used += size;
+
+  self->num_allocs++;
+  self->bytes_used += size;
+
+  return ptr;
+}
+
+void *arena_realloc(Arena_t *self, void *ptr, size_t old_size, size_t size) {
+
+  /* memory is never returned to the arena, the old contents are
+   * simply left behind */
+
+  void *new = arena_alloc(self, size);
+
+  if(ptr != NULL)
+    memcpy(new, ptr, (old_size < size) ? old_size : size);
+
+  return new;
+}
+
+char *arena_strdup(Arena_t *self, const char *str) {
+  return arena_strndup(self, str, strlen(str));
+}
+
+char *arena_strndup(Arena_t *self, const char *str, size_t n) {
+  char *copy;
+  const char *end = memchr(str, '\0', n);
+  size_t len = (end != NULL) ? (size_t)(end - str) : n;
+
+  copy = (char *) arena_alloc(self, len+1);
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+
+  return copy;
+}
+
+void arena_free(Arena_t *self) {
+  ArenaBlock_t *block;
+
+  if(self == NULL)
+    return;
+
+  while(self->blocks != NULL) {
+    block = self->blocks;
+    self->blocks = block->next;
+    free(block->data);
+    free(block);
+  }
+  free(self);
+}
@@ -0,0 +1,29 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGNMENT 16
+
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  size_t size;
+  size_t used;
+  char *data;
+} ArenaBlock_t;
+
+typedef struct Arena {
+  ArenaBlock_t *blocks;
+  unsigned long num_allocs;
+  unsigned long num_blocks;
+  size_t bytes_used;
+  size_t bytes_reserved;
+} Arena_t;
+
+Arena_t* arena_new(void);
+void *arena_alloc(Arena_t *self, size_t size);
+void *arena_realloc(Arena_t *self, void *ptr, size_t old_size, size_t size);
+char *arena_strdup(Arena_t *self, const char *str);
+char *arena_strndup(Arena_t *self, const char *str, size_t n);
+void arena_free(Arena_t *self);
+
+#endif /* #ifndef ARENA_H */
@@ -0,0 +1,157 @@
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 500
+#endif /* _XOPEN_SOURCE */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <X11/Xlib.h>
+
+#include "arena.h"
+#include "key.h"
+#include "binding.h"
+#include "automaton.h"
+#include "xchainkeys.h"
+
+extern XChainKeys_t *xc;
+
+/* The binding tree compiled into a flat state transition table. Each
+ * chain (:enter binding) is a state, and the keys bound within it are
+ * a contiguous run of transitions sorted by key, so that a keystroke
+ * in a chain is resolved by a binary search over one array instead
+ * of following child and key pointers through the tree. */
+
+Automaton_t* automaton_new(Binding_t *root) {
+  Automaton_t *self = (Automaton_t *) calloc(1, sizeof(Automaton_t));
+  int num_states = 0;
+  int num_transitions = 0;
+
+  automaton_count(root, &num_states, &num_transitions);
+
+  self->states = (State_t *) calloc(num_states, sizeof(State_t));
+  self->transitions = (Transition_t *) calloc(num_transitions+1, 
+					      sizeof(Transition_t));
+  self->num_states = 0;
+  self->num_transitions = 0;
+
+  automaton_add_state(self, root);
+
+  return self;
+}
+
+void automaton_count(Binding_t *binding, int *num_states, int *num_transitions) {
+  int i;
+
+  binding->state = -1;
+
+  /* only chains have a state, the children of other bindings can
+   * never be reached */
+  if(binding->parent != NULL && binding->action != XC_ACTION_ENTER)
+    return;
+
+  *num_states += 1;
+  *num_transitions += binding->num_children;
+
+  for( i=0; i<binding->num_children; i++ ) {
+    automaton_count(binding->children[i], num_states, num_transitions);
+  }
+}
+
+int automaton_add_state(Automaton_t *self, Binding_t *binding) {
+  State_t *state;
+  Transition_t *transition;
+  int id = self->num_states++;
+  int i;
+
+  state = &self->states[id];
+  state->binding = binding;
+  state->first = self->num_transitions;
+  state->num_transitions = binding->num_children;
+
+  binding->state = id;
+
+  self->num_transitions += binding->num_children;
+
+  for( i=0; i<binding->num_children; i++ ) {
+    transition = &self->transitions[state->first + i];
+    automaton_set_transition(transition, binding->children[i]);
+    transition->order = i;
+  }
+
+  qsort(&self->transitions[state->first], state->num_transitions,
+	sizeof(Transition_t), automaton_compare);
+
+  /* the target states of nested chains follow after this one */
+  for( i=0; i<state->num_transitions; i++ ) {
+    transition = &self->transitions[state->first + i];
+
+    if(transition->action == XC_ACTION_ENTER)
+      transition->target = automaton_add_state(self, transition->binding);
+  }
+  return id;
+}
+
+void automaton_set_transition(Transition_t *transition, Binding_t *binding) {
+  transition->key = automaton_key(binding->key->keycode, 
+				  binding->key->modifiers);
+  transition->order = 0;
+  transition->action = binding->action;
+  transition->abort = binding->abort;
+  transition->target = binding->state;
+  transition->name = binding->name;
+  transition->binding = binding;
+}
+
+unsigned int automaton_key(unsigned int keycode, unsigned int modifiers) {
+  return (keycode << 8) | (modifiers & XC_MODIFIERS);
+}
+
+int automaton_compare(const void *a, const void *b) {
+  const Transition_t *ta = (const Transition_t *) a;
+  const Transition_t *tb = (const Transition_t *) b;
+
+  if(ta->key != tb->key)
+    return (ta->key < tb->key) ? -1 : 1;
+
+  /* keep the first of several bindings for the same key in front */
+  return ta->order - tb->order;
+}
+
+Transition_t *automaton_lookup(Automaton_t *self, int state, Key_t *key) {
+  Transition_t *transitions = &self->transitions[self->states[state].first];
+  unsigned int wanted = automaton_key(key->keycode, key->modifiers);
+  int low = 0;
+  int high = self->states[state].num_transitions;
+  int mid;
+
+  /* find the first transition for this key */
+  while(low < high) {
+    mid = (low + high) / 2;
+
+    if(transitions[mid].key < wanted)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  if(low < self->states[state].num_transitions && 
+     transitions[low].key == wanted)
+    return &transitions[low];
+
+  return NULL;
+}
+
+size_t automaton_size(Automaton_t *self) {
+  return sizeof(Automaton_t) + 
+    self->num_states * sizeof(State_t) +
+    self->num_transitions * sizeof(Transition_t);
+}
+
+void automaton_free(Automaton_t *self) {
+  if(self == NULL)
+    return;
+
+  free(self->states);
+  free(self->transitions);
+  free(self);
+}
@@ -0,0 +1,37 @@
+#ifndef AUTOMATON_H
+#define AUTOMATON_H
+
+typedef struct Transition {
+  unsigned int key;
+  int order;
+  int action;
+  int abort;
+  int target;
+  char *name;
+  struct Binding *binding;
+} Transition_t;
+
+typedef struct State {
+  int first;
+  int num_transitions;
+  struct Binding *binding;
+} State_t;
+
+typedef struct Automaton {
+  State_t *states;
+  int num_states;
+  Transition_t *transitions;
+  int num_transitions;
+} Automaton_t;
+
+Automaton_t* automaton_new(Binding_t *root);
+void automaton_count(Binding_t *binding, int *num_states, int *num_transitions);
+int automaton_add_state(Automaton_t *self, Binding_t *binding);
+void automaton_set_transition(Transition_t *transition, Binding_t *binding);
+unsigned int automaton_key(unsigned int keycode, unsigned int modifiers);
+int automaton_compare(const void *a, const void *b);
+Transition_t *automaton_lookup(Automaton_t *self, int state, Key_t *key);
+size_t automaton_size(Automaton_t *self);
+void automaton_free(Automaton_t *self);
+
+#endif /* #ifndef AUTOMATON_H */
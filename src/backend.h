@@ -0,0 +1,79 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+/* stages of handling a key press, see backend_mark() */
+#define BACKEND_MARK_INJECT   0
+#define BACKEND_MARK_RECEIPT  1
+#define BACKEND_MARK_DISPATCH 2
+#define BACKEND_MARK_DRAW     3
+#define BACKEND_MARK_EXEC     4
+#define BACKEND_NUM_MARKS     5
+
+/* Every request xchainkeys sends to the X server goes through these
+ * functions. The implementation is chosen when linking:
+ *
+ * backend_xlib.c  plain Xlib calls, each request that needs a reply
+ *                 is a round trip.
+ * backend_xcb.c   (configure --with-xcb) replaces the requests that
+ *                 may need a reply with XCB requests on the same
+ *                 connection, blocking only where the reply is used.
+ * backend_fake.c  an in-memory server for tests and benchmarks, see
+ *                 backend_fake.h.
+ *
+ * Functions of Xlib that never touch the connection (XStringToKeysym,
+ * XParseGeometry, XTextWidth, ...) are still called directly. */
+
+/* connection and clock */
+const char *backend_name(void);
+Display *backend_open_display(char *name);
+int backend_pending(Display *display);
+int backend_events_queued(Display *display);
+void backend_next_event(Display *display, XEvent *event);
+void backend_flush(Display *display);
+long backend_usec(void);
+int backend_idle(long usec);
+unsigned long backend_round_trips(void);
+void backend_mark(int stage);
+
+/* keyboard mapping */
+KeyCode backend_keysym_to_keycode(Display *display, KeySym keysym);
+KeySym backend_keycode_to_keysym(Display *display, KeyCode keycode);
+XModifierKeymap *backend_get_modifier_mapping(Display *display);
+void backend_refresh_keyboard_mapping(XMappingEvent *event);
+
+/* grabs and queries */
+void backend_grab_key(Display *display, int keycode, unsigned int modifiers);
+void backend_ungrab_key(Display *display, int keycode, unsigned int modifiers);
+void backend_grab_keyboard(Display *display);
+void backend_ungrab_keyboard(Display *display);
+Window backend_get_input_focus(Display *display);
+void backend_send_key_event(Display *display, XKeyEvent *event);
+void backend_query_keymap(Display *display, char keymap[32]);
+void backend_query_pointer(Display *display, Window root, int *x, int *y);
+
+/* popup window */
+Window backend_create_window(Display *display, Window parent, 
+			     unsigned long valuemask, 
+			     XSetWindowAttributes *attributes);
+Cursor backend_create_blank_cursor(Display *display, Window root);
+int backend_parse_color(Display *display, Colormap colormap, 
+			char *spec, XColor *color);
+void backend_alloc_colors(Display *display, Colormap colormap, 
+			  XColor *colors, int n);
+void backend_set_window_colors(Display *display, Window window, 
+			       unsigned long border, unsigned long background);
+GC backend_create_gc(Display *display, Drawable drawable, 
+		     unsigned long valuemask, XGCValues *values);
+void backend_set_foreground(Display *display, GC gc, unsigned long pixel);
+void backend_free_gc(Display *display, GC gc);
+XFontStruct *backend_load_font(Display *display, GC gc, char *name);
+void backend_free_font(Display *display, XFontStruct *font);
+void backend_move_resize_window(Display *display, Window window, 
+				int x, int y, int w, int h);
+void backend_clear_window(Display *display, Window window);
+void backend_draw_string(Display *display, Window window, GC gc, 
+			 int x, int y, char *text);
+void backend_map_window(Display *display, Window window);
+void backend_unmap_window(Display *display, Window window);
+
+#endif /* #ifndef BACKEND_H */
@@ -0,0 +1,581 @@
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 500
+#endif /* _XOPEN_SOURCE */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "key.h"
+#include "backend.h"
+#include "backend_fake.h"
+#include "util.h"
+
+/* An X server that lives in memory, for running xchainkeys on
+ * machines without a display. Key presses are scheduled on a virtual
+ * clock, either from the XCHAINKEYS_FAKE_KEYS environment variable or
+ * by calling backend_fake_key(), and are only delivered if a key or
+ * the keyboard is grabbed, like a real server would. Whenever the
+ * event loop would sleep, the clock jumps to the next timer or key
+ * instead, so runs are fast and repeatable. Requests are counted in
+ * the FakeStats_t returned by backend_fake_stats().
+ *
+ * Once nothing is scheduled any more, the server waits for
+ * XCHAINKEYS_FAKE_LINGER milliseconds of real time for launched
+ * commands to exit, then calls the idle callback, which by default
+ * prints the counters and exits. Setting XCHAINKEYS_FAKE_TRACE prints
+ * every request as it is made.
+ *
+ * The stages of handling a key press are passed to the mark callback
+ * along with the real time they happened at, for benchmarks. */
+
+static _XPrivDisplay display = NULL;
+static int connection[2] = { -1, -1 };
+static FakeStats_t stats;
+
+/* the virtual clock starts well away from zero, like the monotonic
+ * clock does */
+static long now = 1000000000L;
+
+static KeySym keysyms[256];
+static unsigned int next_keycode = 10;
+static unsigned char grabs[256][256];
+static int keyboard_grabbed = False;
+
+static XEvent events[FAKE_MAX_EVENTS];
+static int events_head = 0;
+static int events_count = 0;
+
+static FakeKey_t script[FAKE_MAX_SCRIPT];
+static int script_head = 0;
+static int script_count = 0;
+
+static Window next_window = 0x200000;
+static char fake_gc[1];
+static char text[4096];
+
+static int trace = False;
+static long linger = FAKE_LINGER;
+static long linger_until = 0;
+static void (*idle_callback)(void) = NULL;
+static void (*mark_callback)(int stage, long usec) = NULL;
+
+static void fake_trace(char *request, char *detail) {
+  if (trace) {
+    fprintf(stderr, "fake: %ld.%03ld %s %s\n", now / 1000, now % 1000,
+	    request, detail);
+    fflush(stderr);
+  }
+}
+
+static void fake_request(int round_trip) {
+  display->request++;
+  stats.requests++;
+  if (round_trip)
+    stats.round_trips++;
+}
+
+static long fake_real_usec(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long)(ts.tv_sec*1000000 + (ts.tv_nsec/1000));
+}
+
+static void fake_signal(void) {
+  char byte = 0;
+
+  /* the connection is readable exactly while events are queued */
+  if (events_count > 0) {
+    if (write(connection[1], &byte, 1) == -1)
+      return;
+  }
+  else
+    while (read(connection[0], &byte, 1) > 0);
+}
+
+static void fake_push(int type, FakeKey_t *key) {
+  XKeyEvent *event;
+
+  if (events_count == FAKE_MAX_EVENTS)
+    return;
+
+  event = &events[(events_head + events_count++) % FAKE_MAX_EVENTS].xkey;
+  memset(event, 0, sizeof(XEvent));
+
+  event->type = type;
+  event->serial = display->request;
+  event->send_event = False;
+  event->display = (Display *) display;
+  event->window = DefaultRootWindow(display);
+  event->root = event->window;
+  event->subwindow = None;
+  event->time = (Time) (now / 1000);
+  event->x = event->y = event->x_root = event->y_root = 1;
+  event->state = key->state;
+  event->keycode = key->keycode;
+  event->same_screen = True;
+}
+
+static void fake_release(void) {
+  FakeKey_t *key;
+  int was_empty = (events_count == 0);
+
+  /* deliver the keys that are due, pressed and released at once */
+  while (script_count > 0 && script[script_head].at <= now) {
+    key = &script[script_head];
+    script_head = (script_head + 1) % FAKE_MAX_SCRIPT;
+    script_count--;
+
+    if (keyboard_grabbed || grabs[key->keycode][key->state & 0xff]) {
+      fake_push(KeyPress, key);
+      fake_push(KeyRelease, key);
+      stats.events++;
+      backend_mark(BACKEND_MARK_INJECT);
+      fake_trace("press", XKeysymToString(keysyms[key->keycode]));
+    }
+    else {
+      stats.dropped++;
+      fake_trace("drop", XKeysymToString(keysyms[key->keycode]));
+    }
+    linger_until = 0;
+  }
+
+  if (was_empty && events_count > 0)
+    fake_signal();
+}
+
+static unsigned int fake_keycode(KeySym keysym) {
+  KeySym lower, upper;
+  unsigned int keycode;
+
+  if (keysym == NoSymbol)
+    return 0;
+
+  /* like on a real keyboard, both cases share a key */
+  XConvertCase(keysym, &lower, &upper);
+
+  for (keycode = 8; keycode < next_keycode; keycode++) {
+    if (keysyms[keycode] == lower)
+      return keycode;
+  }
+  if (next_keycode > 255)
+    return 0;
+
+  keysyms[next_keycode] = lower;
+  return next_keycode++;
+}
+
+const char *backend_name(void) {
+  return "fake";
+}
+
+Display *backend_open_display(char *name) {
+  char *value;
+
+  if (display != NULL)
+    return (Display *) display;
+
+  if (pipe(connection) == -1)
+    return NULL;
+  fcntl(connection[0], F_SETFL, O_NONBLOCK);
+
+  display = (_XPrivDisplay) calloc(1, sizeof(*display));
+  display->screens = (Screen *) calloc(1, sizeof(Screen));
+  display->nscreens = 1;
+  display->default_screen = 0;
+  display->fd = connection[0];
+  display->request = 1;
+
+  display->screens[0].display = (Display *) display;
+  display->screens[0].root = 1;
+  display->screens[0].width = 1280;
+  display->screens[0].height = 1024;
+  display->screens[0].root_depth = 24;
+  display->screens[0].cmap = 2;
+
+  /* the modifier keys get the first keycodes, see
+   * backend_get_modifier_mapping() */
+  fake_keycode(XStringToKeysym("Shift_L"));
+  fake_keycode(XStringToKeysym("Caps_Lock"));
+  fake_keycode(XStringToKeysym("Control_L"));
+  fake_keycode(XStringToKeysym("Alt_L"));
+  fake_keycode(XStringToKeysym("Num_Lock"));
+  fake_keycode(XStringToKeysym("Super_L"));
+
+  memset(&stats, 0, sizeof(FakeStats_t));
+
+  if ((value = getenv("XCHAINKEYS_FAKE_TRACE")) != NULL)
+    trace = True;
+
+  if ((value = getenv("XCHAINKEYS_FAKE_LINGER")) != NULL)
+    linger = atol(value);
+
+  if ((value = getenv("XCHAINKEYS_FAKE_KEYS")) != NULL) {
+    if (!backend_fake_script(value)) {
+      fprintf(stderr, "%s: error: invalid XCHAINKEYS_FAKE_KEYS '%s'\n",
+	      PACKAGE_NAME, value);
+      fflush(stderr);
+    }
+  }
+
+  fake_trace("open", name != NULL ? name : "fake");
+  return (Display *) display;
+}
+
+int backend_pending(Display *d) {
+  return events_count;
+}
+
+int backend_events_queued(Display *d) {
+  return events_count;
+}
+
+void backend_next_event(Display *d, XEvent *event) {
+  int timeout;
+
+  /* block like Xlib does, by running the clock */
+  while (events_count == 0) {
+    if ((timeout = backend_idle(-1)) > 0)
+      usleep(timeout * 1000);
+  }
+
+  *event = events[events_head];
+  events_head = (events_head + 1) % FAKE_MAX_EVENTS;
+  events_count--;
+
+  if (events_count == 0)
+    fake_signal();
+
+  if (event->type == KeyPress)
+    backend_mark(BACKEND_MARK_RECEIPT);
+}
+
+void backend_flush(Display *d) {
+}
+
+long backend_usec(void) {
+  return now;
+}
+
+int backend_idle(long usec) {
+  long remaining;
+
+  if (events_count > 0)
+    return 0;
+
+  /* jump to the next key or timer, whichever comes first */
+  if (script_count > 0 &&
+      (usec < 0 || script[script_head].at - now <= usec)) {
+    if (script[script_head].at > now)
+      now = script[script_head].at;
+    fake_release();
+    return 0;
+  }
+
+  if (usec >= 0) {
+    now += usec;
+    return 0;
+  }
+
+  /* nothing scheduled: give launched commands some real time to
+   * exit, then let the driver decide */
+  if (linger_until == 0)
+    linger_until = fake_real_usec() + linger * 1000;
+
+  remaining = linger_until - fake_real_usec();
+  if (remaining > 0)
+    return (int) ((remaining + 999) / 1000);
+
+  linger_until = 0;
+
+  if (idle_callback != NULL) {
+    idle_callback();
+  }
+  else {
+    backend_fake_report(stderr);
+    exit(EXIT_SUCCESS);
+  }
+  return 0;
+}
+
+unsigned long backend_round_trips(void) {
+  return stats.round_trips;
+}
+
+void backend_mark(int stage) {
+  if (mark_callback != NULL)
+    mark_callback(stage, fake_real_usec());
+}
+
+KeyCode backend_keysym_to_keycode(Display *d, KeySym keysym) {
+  return fake_keycode(keysym);
+}
+
+KeySym backend_keycode_to_keysym(Display *d, KeyCode keycode) {
+  return keysyms[keycode];
+}
+
+XModifierKeymap *backend_get_modifier_mapping(Display *d) {
+  XModifierKeymap *xmodmap = XNewModifiermap(1);
+  int i;
+
+  fake_request(True);
+
+  /* Shift, Lock, Control, Mod1, Mod2 and Mod4 get the keycodes
+   * assigned in backend_open_display() */
+  for (i = 0; i < 6; i++)
+    xmodmap->modifiermap[(i < 5) ? i : 6] = 10 + i;
+
+  return xmodmap;
+}
+
+void backend_refresh_keyboard_mapping(XMappingEvent *event) {
+}
+
+void backend_grab_key(Display *d, int keycode, unsigned int modifiers) {
+  fake_request(False);
+  stats.key_grabs++;
+  grabs[keycode & 0xff][modifiers & 0xff] = True;
+}
+
+void backend_ungrab_key(Display *d, int keycode, unsigned int modifiers) {
+  fake_request(False);
+  stats.key_ungrabs++;
+  grabs[keycode & 0xff][modifiers & 0xff] = False;
+}
+
+void backend_grab_keyboard(Display *d) {
+  fake_request(True);
+  stats.keyboard_grabs++;
+  keyboard_grabbed = True;
+  fake_trace("grab", "keyboard");
+}
+
+void backend_ungrab_keyboard(Display *d) {
+  fake_request(False);
+  stats.keyboard_ungrabs++;
+  keyboard_grabbed = False;
+  fake_trace("ungrab", "keyboard");
+}
+
+Window backend_get_input_focus(Display *d) {
+  fake_request(True);
+  return 0x100000;
+}
+
+void backend_send_key_event(Display *d, XKeyEvent *event) {
+  fake_request(True);
+  stats.sends++;
+  fake_trace("send", XKeysymToString(keysyms[event->keycode & 0xff]));
+}
+
+void backend_query_keymap(Display *d, char keymap[32]) {
+  fake_request(True);
+  memset(keymap, 0, 32);
+}
+
+void backend_query_pointer(Display *d, Window root, int *x, int *y) {
+  fake_request(True);
+  *x = display->screens[0].width / 2;
+  *y = display->screens[0].height / 2;
+}
+
+Window backend_create_window(Display *d, Window parent,
+			     unsigned long valuemask,
+			     XSetWindowAttributes *attributes) {
+  fake_request(False);
+  return next_window++;
+}
+
+Cursor backend_create_blank_cursor(Display *d, Window root) {
+  fake_request(False);
+  return next_window++;
+}
+
+int backend_parse_color(Display *d, Colormap colormap,
+			char *spec, XColor *color) {
+  memset(color, 0, sizeof(XColor));
+  return True;
+}
+
+void backend_alloc_colors(Display *d, Colormap colormap,
+			  XColor *colors, int n) {
+  int i;
+
+  fake_request(True);
+  for (i = 0; i < n; i++)
+    colors[i].pixel = i;
+}
+
+void backend_set_window_colors(Display *d, Window window,
+			       unsigned long border, unsigned long background) {
+  fake_request(False);
+}
+
+GC backend_create_gc(Display *d, Drawable drawable,
+		     unsigned long valuemask, XGCValues *values) {
+  fake_request(False);
+  return (GC) fake_gc;
+}
+
+void backend_set_foreground(Display *d, GC gc, unsigned long pixel) {
+  fake_request(False);
+}
+
+void backend_free_gc(Display *d, GC gc) {
+  fake_request(False);
+}
+
+XFontStruct *backend_load_font(Display *d, GC gc, char *name) {
+  XFontStruct *font = (XFontStruct *) calloc(1, sizeof(XFontStruct));
+
+  fake_request(True);
+
+  /* a fixed width font, enough for XTextWidth() */
+  font->fid = next_window++;
+  font->min_char_or_byte2 = 0;
+  font->max_char_or_byte2 = 255;
+  font->all_chars_exist = True;
+  font->min_bounds.width = font->max_bounds.width = 6;
+  font->ascent = 10;
+  font->descent = 2;
+  return font;
+}
+
+void backend_free_font(Display *d, XFontStruct *font) {
+  fake_request(False);
+  free(font);
+}
+
+void backend_move_resize_window(Display *d, Window window,
+				int x, int y, int w, int h) {
+  fake_request(False);
+}
+
+void backend_clear_window(Display *d, Window window) {
+  fake_request(False);
+}
+
+void backend_draw_string(Display *d, Window window, GC gc,
+			 int x, int y, char *string) {
+  fake_request(False);
+  stats.draws++;
+  strncpy(text, string, sizeof(text) - 1);
+  fake_trace("draw", text);
+  backend_mark(BACKEND_MARK_DRAW);
+}
+
+void backend_map_window(Display *d, Window window) {
+  fake_request(False);
+  stats.maps++;
+  fake_trace("map", "popup");
+}
+
+void backend_unmap_window(Display *d, Window window) {
+  fake_request(False);
+  stats.unmaps++;
+  fake_trace("unmap", "popup");
+}
+
+int backend_fake_key(char *keyspec, long delay) {
+  FakeKey_t *key;
+  char name[256];
+  char *dash;
+  unsigned int modifier;
+  long at = now;
+
+  if (script_count == FAKE_MAX_SCRIPT)
+    return False;
+
+  /* keys are scheduled relative to the previous one */
+  if (script_count > 0)
+    at = script[(script_head + script_count - 1) % FAKE_MAX_SCRIPT].at;
+
+  key = &script[(script_head + script_count) % FAKE_MAX_SCRIPT];
+  key->at = at + delay;
+  key->state = 0;
+
+  strncpy(name, keyspec, sizeof(name) - 1);
+  name[sizeof(name) - 1] = '\0';
+  keyspec = name;
+
+  while ((dash = strchr(keyspec, '-')) != NULL && dash != keyspec) {
+    *dash = '\0';
+    if ((modifier = modname_to_modifier(keyspec)) == 0)
+      return False;
+    key->state |= modifier;
+    keyspec = dash + 1;
+  }
+
+  if ((key->keycode = fake_keycode(XStringToKeysym(keyspec))) == 0)
+    return False;
+
+  script_count++;
+  linger_until = 0;
+  return True;
+}
+
+int backend_fake_script(char *script) {
+  char *copy = (char *) calloc(strlen(script) + 1, sizeof(char));
+  char *token;
+  char *ws = " \t\n";
+  long delay = 0;
+  int ret = True;
+
+  /* a list of keyspecs, separated by whitespace. A key follows the
+   * previous one after FAKE_KEY_INTERVAL, or after +N milliseconds */
+  strcpy(copy, script);
+
+  for (token = strtok(copy, ws); token != NULL; token = strtok(NULL, ws)) {
+    if (token[0] == '+') {
+      delay += atol(token + 1) * 1000;
+      continue;
+    }
+    if (!backend_fake_key(token, delay ? delay : FAKE_KEY_INTERVAL)) {
+      ret = False;
+      break;
+    }
+    delay = 0;
+  }
+
+  free(copy);
+  return ret;
+}
+
+void backend_fake_advance(long usec) {
+  now += usec;
+  fake_release();
+}
+
+void backend_fake_on_idle(void (*callback)(void)) {
+  idle_callback = callback;
+}
+
+void backend_fake_on_mark(void (*callback)(int stage, long usec)) {
+  mark_callback = callback;
+}
+
+FakeStats_t *backend_fake_stats(void) {
+  return &stats;
+}
+
+char *backend_fake_text(void) {
+  return text;
+}
+
+void backend_fake_report(FILE *stream) {
+  fprintf(stream, "fake: requests=%lu round_trips=%lu key_grabs=%lu "
+	  "key_ungrabs=%lu keyboard_grabs=%lu keyboard_ungrabs=%lu "
+	  "sends=%lu draws=%lu maps=%lu unmaps=%lu events=%lu dropped=%lu\n",
+	  stats.requests, stats.round_trips, stats.key_grabs,
+	  stats.key_ungrabs, stats.keyboard_grabs, stats.keyboard_ungrabs,
+	  stats.sends, stats.draws, stats.maps, stats.unmaps,
+	  stats.events, stats.dropped);
+  fflush(stream);
+}
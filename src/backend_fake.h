@@ -0,0 +1,41 @@
+#ifndef BACKEND_FAKE_H
+#define BACKEND_FAKE_H
+
+#define FAKE_MAX_EVENTS 1024
+#define FAKE_MAX_SCRIPT 4096
+#define FAKE_KEY_INTERVAL 10000
+#define FAKE_LINGER 100
+
+/* what the fake server has been asked to do */
+typedef struct FakeStats {
+  unsigned long requests;
+  unsigned long round_trips;
+  unsigned long key_grabs;
+  unsigned long key_ungrabs;
+  unsigned long keyboard_grabs;
+  unsigned long keyboard_ungrabs;
+  unsigned long sends;
+  unsigned long draws;
+  unsigned long maps;
+  unsigned long unmaps;
+  unsigned long events;
+  unsigned long dropped;
+} FakeStats_t;
+
+/* a key press scheduled on the virtual clock */
+typedef struct FakeKey {
+  long at;
+  unsigned int keycode;
+  unsigned int state;
+} FakeKey_t;
+
+int backend_fake_key(char *keyspec, long delay);
+int backend_fake_script(char *script);
+void backend_fake_advance(long usec);
+void backend_fake_on_idle(void (*callback)(void));
+void backend_fake_on_mark(void (*callback)(int stage, long usec));
+FakeStats_t *backend_fake_stats(void);
+char *backend_fake_text(void);
+void backend_fake_report(FILE *stream);
+
+#endif /* #ifndef BACKEND_FAKE_H */
@@ -0,0 +1,144 @@
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 500
+#endif /* _XOPEN_SOURCE */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+
+#include "backend.h"
+
+/* The requests are issued through the XCB connection underneath the
+ * Xlib display, so they are queued in order with everything Xlib has
+ * buffered. Replies that aren't needed are discarded instead of
+ * waited for, and requests whose replies are needed together are all
+ * sent before the first reply is read. */
+
+/* number of times we blocked waiting for a reply, see backend_xlib.c */
+extern unsigned long backend_round_trip_count;
+
+const char *backend_name(void) {
+  return "xcb";
+}
+
+void backend_grab_keyboard(Display *display) {
+  xcb_connection_t *c = XGetXCBConnection(display);
+  xcb_grab_keyboard_cookie_t cookie;
+
+  /* the grab status isn't used, don't wait for it */
+  cookie = xcb_grab_keyboard_unchecked(c, True, DefaultRootWindow(display),
+				       XCB_CURRENT_TIME, 
+				       XCB_GRAB_MODE_ASYNC, 
+				       XCB_GRAB_MODE_ASYNC);
+  xcb_discard_reply(c, cookie.sequence);
+  xcb_flush(c);
+}
+
+void backend_ungrab_keyboard(Display *display) {
+  xcb_connection_t *c = XGetXCBConnection(display);
+
+  xcb_ungrab_keyboard(c, XCB_CURRENT_TIME);
+}
+
+Window backend_get_input_focus(Display *display) {
+  xcb_connection_t *c = XGetXCBConnection(display);
+  xcb_get_input_focus_reply_t *reply;
+  Window window = None;
+
+  reply = xcb_get_input_focus_reply(c, xcb_get_input_focus(c), NULL);
+  backend_round_trip_count++;
+
+  if (reply != NULL) {
+    window = reply->focus;
+    free(reply);
+  }
+  return window;
+}
+
+void backend_send_key_event(Display *display, XKeyEvent *event) {
+  xcb_connection_t *c = XGetXCBConnection(display);
+  xcb_key_press_event_t e;
+
+  /* the request is ordered before anything we send later, so there's
+   * no need to sync with the server */
+  memset(&e, 0, sizeof(e));
+  e.response_type = XCB_KEY_PRESS;
+  e.detail = event->keycode;
+  e.time = event->time;
+  e.root = DefaultRootWindow(display);
+  e.event = event->window;
+  e.child = event->subwindow;
+  e.root_x = event->x_root;
+  e.root_y = event->y_root;
+  e.event_x = event->x;
+  e.event_y = event->y;
+  e.state = event->state;
+  e.same_screen = event->same_screen;
+
+  xcb_send_event(c, True, event->window, XCB_EVENT_MASK_KEY_PRESS, 
+		 (const char *)&e);
+  xcb_flush(c);
+}
+
+void backend_query_keymap(Display *display, char keymap[32]) {
+  xcb_connection_t *c = XGetXCBConnection(display);
+  xcb_query_keymap_reply_t *reply;
+
+  reply = xcb_query_keymap_reply(c, xcb_query_keymap(c), NULL);
+  backend_round_trip_count++;
+
+  memset(keymap, 0, 32);
+  if (reply != NULL) {
+    memcpy(keymap, reply->keys, 32);
+    free(reply);
+  }
+}
+
+void backend_query_pointer(Display *display, Window root, int *x, int *y) {
+  xcb_connection_t *c = XGetXCBConnection(display);
+  xcb_query_pointer_reply_t *reply;
+
+  reply = xcb_query_pointer_reply(c, xcb_query_pointer(c, root), NULL);
+  backend_round_trip_count++;
+
+  *x = *y = 0;
+  if (reply != NULL) {
+    *x = reply->root_x;
+    *y = reply->root_y;
+    free(reply);
+  }
+}
+
+void backend_alloc_colors(Display *display, Colormap colormap, 
+			  XColor *colors, int n) {
+  xcb_connection_t *c = XGetXCBConnection(display);
+  xcb_alloc_color_cookie_t *cookies;
+  xcb_alloc_color_reply_t *reply;
+  int i;
+
+  cookies = (xcb_alloc_color_cookie_t *) 
+    calloc(n, sizeof(xcb_alloc_color_cookie_t));
+
+  /* send all requests first, then collect the replies */
+  for (i = 0; i < n; i++) {
+    cookies[i] = xcb_alloc_color(c, colormap, colors[i].red, 
+				 colors[i].green, colors[i].blue);
+  }
+  if (n > 0)
+    backend_round_trip_count++;
+
+  for (i = 0; i < n; i++) {
+    reply = xcb_alloc_color_reply(c, cookies[i], NULL);
+    if (reply != NULL) {
+      colors[i].pixel = reply->pixel;
+      colors[i].red = reply->red;
+      colors[i].green = reply->green;
+      colors[i].blue = reply->blue;
+      free(reply);
+    }
+  }
+  free(cookies);
+}
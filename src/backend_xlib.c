@@ -0,0 +1,242 @@
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 500
+#endif /* _XOPEN_SOURCE */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <X11/Xlib.h>
+
+#include "backend.h"
+
+/* number of requests that waited for a reply, backend_xcb.c counts
+ * its own as well */
+unsigned long backend_round_trip_count = 0;
+
+Display *backend_open_display(char *name) {
+  return XOpenDisplay(name);
+}
+
+int backend_pending(Display *display) {
+  return XPending(display);
+}
+
+int backend_events_queued(Display *display) {
+  return XEventsQueued(display, QueuedAlready);
+}
+
+void backend_next_event(Display *display, XEvent *event) {
+  XNextEvent(display, event);
+}
+
+void backend_flush(Display *display) {
+  XFlush(display);
+}
+
+long backend_usec(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long)(ts.tv_sec*1000000 + (ts.tv_nsec/1000));
+}
+
+int backend_idle(long usec) {
+
+  /* a real server: sleep until the deadline */
+  if (usec < 0)
+    return -1;
+  return (int) ((usec + 999) / 1000);
+}
+
+KeyCode backend_keysym_to_keycode(Display *display, KeySym keysym) {
+  return XKeysymToKeycode(display, keysym);
+}
+
+KeySym backend_keycode_to_keysym(Display *display, KeyCode keycode) {
+  return XKeycodeToKeysym(display, keycode, 0);
+}
+
+XModifierKeymap *backend_get_modifier_mapping(Display *display) {
+  backend_round_trip_count++;
+  return XGetModifierMapping(display);
+}
+
+void backend_refresh_keyboard_mapping(XMappingEvent *event) {
+  XRefreshKeyboardMapping(event);
+}
+
+void backend_grab_key(Display *display, int keycode, unsigned int modifiers) {
+  XGrabKey(display, keycode, modifiers, DefaultRootWindow(display), False,
+	   GrabModeAsync, GrabModeAsync);
+}
+
+void backend_ungrab_key(Display *display, int keycode, unsigned int modifiers) {
+  XUngrabKey(display, keycode, modifiers, DefaultRootWindow(display));
+}
+
+#ifndef WITH_XCB
+
+/* these may wait for the server, backend_xcb.c replaces them */
+
+const char *backend_name(void) {
+  return "xlib";
+}
+
+void backend_grab_keyboard(Display *display) {
+
+  XGrabKeyboard(display, DefaultRootWindow(display),
+		True, GrabModeAsync, GrabModeAsync, CurrentTime);
+  backend_round_trip_count++;
+}
+
+void backend_ungrab_keyboard(Display *display) {
+  XUngrabKeyboard(display, CurrentTime);
+}
+
+Window backend_get_input_focus(Display *display) {
+  Window window;
+  int revert_to;
+
+  XGetInputFocus(display, &window, &revert_to);
+  backend_round_trip_count++;
+
+  return window;
+}
+
+void backend_send_key_event(Display *display, XKeyEvent *event) {
+
+  XSendEvent(display, event->window, True, KeyPressMask, (XEvent *)event);
+  XSync(display, False);
+  backend_round_trip_count++;
+}
+
+void backend_query_keymap(Display *display, char keymap[32]) {
+
+  XQueryKeymap(display, keymap);
+  backend_round_trip_count++;
+}
+
+void backend_query_pointer(Display *display, Window root, int *x, int *y) {
+  Window ignored_root, ignored_child;
+  int ignored_x, ignored_y;
+  unsigned int ignored_mask;
+
+  XQueryPointer(display, root, &ignored_root, &ignored_child,
+		x, y, &ignored_x, &ignored_y, &ignored_mask);
+  backend_round_trip_count++;
+}
+
+void backend_alloc_colors(Display *display, Colormap colormap, 
+			  XColor *colors, int n) {
+  int i;
+
+  for (i = 0; i < n; i++) {
+    XAllocColor(display, colormap, &colors[i]);
+    backend_round_trip_count++;
+  }
+}
+
+#endif /* #ifndef WITH_XCB */
+
+unsigned long backend_round_trips(void) {
+  return backend_round_trip_count;
+}
+
+void backend_mark(int stage) {
+
+  /* only the fake backend timestamps the stages of a key press */
+}
+
+Window backend_create_window(Display *display, Window parent, 
+			     unsigned long valuemask, 
+			     XSetWindowAttributes *attributes) {
+
+  return XCreateWindow(display, parent, 0, 0, 1, 1, 2, 
+		       CopyFromParent, InputOutput, CopyFromParent, 
+		       valuemask, attributes); 
+}
+
+Cursor backend_create_blank_cursor(Display *display, Window root) {
+  Pixmap mask;
+  GC gc;
+  XGCValues values;
+  XColor color;
+  Cursor cursor;
+
+  mask = XCreatePixmap(display, root, 1, 1, 1);
+  values.function = GXclear;
+  gc = XCreateGC(display, mask, GCFunction, &values);
+
+  XFillRectangle(display, mask, gc, 0, 0, 1, 1);
+  color.pixel = 0; color.red = 0; color.flags = 04;
+
+  cursor = XCreatePixmapCursor(display, mask, mask,
+			       &color,&color, 0,0);
+
+  XFreePixmap(display, mask);
+  XFreeGC(display, gc);
+  return cursor;
+}
+
+int backend_parse_color(Display *display, Colormap colormap, 
+			char *spec, XColor *color) {
+  return XParseColor(display, colormap, spec, color);
+}
+
+void backend_set_window_colors(Display *display, Window window, 
+			       unsigned long border, unsigned long background) {
+  XSetWindowBorder(display, window, border);
+  XSetWindowBackground(display, window, background);
+}
+
+GC backend_create_gc(Display *display, Drawable drawable, 
+		     unsigned long valuemask, XGCValues *values) {
+  return XCreateGC(display, drawable, valuemask, values);
+}
+
+void backend_set_foreground(Display *display, GC gc, unsigned long pixel) {
+  XSetForeground(display, gc, pixel);
+}
+
+void backend_free_gc(Display *display, GC gc) {
+  XFreeGC(display, gc);
+}
+
+XFontStruct *backend_load_font(Display *display, GC gc, char *name) {
+  XFontStruct *font;
+
+  font = XLoadQueryFont(display, name);
+  backend_round_trip_count++;
+
+  if (font != NULL)
+    XSetFont(display, gc, font->fid);
+  return font;
+}
+
+void backend_free_font(Display *display, XFontStruct *font) {
+  XFreeFont(display, font);
+}
+
+void backend_move_resize_window(Display *display, Window window, 
+				int x, int y, int w, int h) {
+  XMoveResizeWindow(display, window, x, y, w, h);
+}
+
+void backend_clear_window(Display *display, Window window) {
+  XClearArea(display, window, 0, 0, 0, 0, False);
+}
+
+void backend_draw_string(Display *display, Window window, GC gc, 
+			 int x, int y, char *text) {
+  XDrawString(display, window, gc, x, y, text, strlen(text));
+}
+
+void backend_map_window(Display *display, Window window) {
+  XMapWindow(display, window);
+  XRaiseWindow(display, window);
+}
+
+void backend_unmap_window(Display *display, Window window) {
+  XUnmapWindow(display, window);
+}
@@ -0,0 +1,431 @@
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 500
+#endif /* _XOPEN_SOURCE */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <X11/Xlib.h>
+
+#include "backend.h"
+#include "backend_fake.h"
+#include "xchainkeys.h"
+
+/* Keypress to launch latency benchmark, run by 'make bench'.
+ *
+ * Each scenario is a configuration and a sequence of key presses,
+ * run in a child process against the fake backend. The configuration
+ * is the given example.conf with all commands replaced by 'true', the
+ * popup shown without delay and a group binding added. Optionally it
+ * is padded with generated bindings below C-t to reach a given size.
+ *
+ * For every key press, the time from injecting the key into the fake
+ * server to each later stage of handling it is recorded: receipt of
+ * the event, dispatch of a binding, drawing the popup and spawning
+ * the command. The percentiles of these times and the number of X
+ * round trips and requests per chord are printed.
+ *
+ * With -p, the time xc_parse_config() takes to read a single chain of
+ * the given widths is printed instead, to check that parsing wide
+ * chains stays linear. */
+
+#define BENCH_CHORDS 200
+
+/* the first keysym of the keys in a generated wide chain, the Unicode
+ * keysyms from here on are all distinct and none is a Latin-1 one */
+#define BENCH_FIRST_UNICODE 0x1000
+
+extern XChainKeys_t *xc;
+
+/* the keys of generated bindings: the first one below C-t avoids
+ * those of the example, then digits and letters alternate so that no
+ * chain contains its own key, which is its default :escape */
+static char *bench_first_keys = "abcdefghijklmnopqstuwxyz";
+static char *bench_keys[2] = { "0123456789", "abcdefghijklmnopqrstuvwxyz" };
+
+static char *stage_names[BACKEND_NUM_MARKS] =
+  { "inject", "receipt", "dispatch", "draw", "exec" };
+
+static char *scenario;
+static int generated;
+static int chords;
+
+static long *samples[BACKEND_NUM_MARKS];
+static int num_samples[BACKEND_NUM_MARKS];
+static int seen[BACKEND_NUM_MARKS];
+static long injected = 0;
+static long started = 0;
+static unsigned long round_trips = 0;
+static unsigned long requests = 0;
+
+static void bench_usage(void) {
+  printf("Usage: xchainkeys-bench [options] example.conf\n");
+  printf("       xchainkeys-bench -p widths\n\n");
+  printf("Options:\n");
+  printf("  -n, chords per scenario (default %d)\n", BENCH_CHORDS);
+  printf("  -s, comma separated config sizes to generate, 0 for none\n");
+  printf("      (default 0,1000,10000)\n");
+  printf("  -p, comma separated chain widths to time parsing of, instead\n");
+  printf("      of the latency scenarios (e.g. 1000,5000,10000,50000)\n");
+  printf("  -h, display this help and exit\n");
+  fflush(stdout);
+}
+
+static long bench_usec(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long)(ts.tv_sec*1000000 + (ts.tv_nsec/1000));
+}
+
+static char *bench_level_keys(int level) {
+  return (level == 0) ? bench_first_keys : bench_keys[(level + 1) % 2];
+}
+
+static void bench_path(int index, int depth, char *path) {
+  char keys[16][2];
+  char *level;
+  int i;
+
+  /* the index-th key sequence of the given depth, spelled out as
+   * keyspecs separated by spaces */
+  for (i = depth - 1; i > 0; i--) {
+    level = bench_level_keys(i);
+    keys[i][0] = level[index % strlen(level)];
+    keys[i][1] = '\0';
+    index /= strlen(level);
+  }
+  keys[0][0] = bench_first_keys[index % strlen(bench_first_keys)];
+  keys[0][1] = '\0';
+
+  strcpy(path, keys[0]);
+  for (i = 1; i < depth; i++) {
+    strcat(path, " ");
+    strcat(path, keys[i]);
+  }
+}
+
+static int bench_depth(int size) {
+  int depth = 1;
+  long capacity = strlen(bench_first_keys);
+
+  while (capacity < size && depth < 16) {
+    capacity *= strlen(bench_level_keys(depth));
+    depth++;
+  }
+  return depth;
+}
+
+static char *bench_write_config(char *example, int size, char *last) {
+  static char file[] = "/tmp/xchainkeys-bench-XXXXXX";
+  char line[4096];
+  char path[64];
+  char *exec;
+  FILE *in, *out;
+  int fd, i;
+  int depth = bench_depth(size);
+
+  strcpy(file + strlen(file) - 6, "XXXXXX");
+
+  if ((in = fopen(example, "r")) == NULL) {
+    fprintf(stderr, "%s: error: failed to open '%s'\n", PACKAGE_NAME,
+	    example);
+    fflush(stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  if ((fd = mkstemp(file)) == -1 || (out = fdopen(fd, "w")) == NULL) {
+    fprintf(stderr, "%s: error: failed to create '%s'\n", PACKAGE_NAME,
+	    file);
+    fflush(stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  /* the example, launching nothing but 'true' */
+  while (fgets(line, sizeof(line), in) != NULL) {
+    if ((exec = strstr(line, ":exec ")) != NULL)
+      strcpy(exec, ":exec true\n");
+    fputs(line, out);
+  }
+  fclose(in);
+
+  fprintf(out, "\ndelay 0\n");
+  fprintf(out, "C-t v :group \"bench\" true\n");
+
+  last[0] = '\0';
+  for (i = 0; i < size; i++) {
+    bench_path(i, depth, path);
+    fprintf(out, "C-t %s :exec true\n", path);
+    strcpy(last, path);
+  }
+  fclose(out);
+
+  return file;
+}
+
+static char *bench_write_chain(int width) {
+  static char file[] = "/tmp/xchainkeys-bench-XXXXXX";
+  FILE *out;
+  int fd, i;
+
+  strcpy(file + strlen(file) - 6, "XXXXXX");
+
+  if ((fd = mkstemp(file)) == -1 || (out = fdopen(fd, "w")) == NULL) {
+    fprintf(stderr, "%s: error: failed to create '%s'\n", PACKAGE_NAME,
+	    file);
+    fflush(stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  /* one chain below C-t with width distinct keys */
+  fprintf(out, "delay 0\n");
+  for (i = 0; i < width; i++)
+    fprintf(out, "C-t U%04X :exec true\n", BENCH_FIRST_UNICODE + i);
+  fclose(out);
+
+  return file;
+}
+
+static int bench_compare(const void *a, const void *b) {
+  long x = *(const long *) a;
+  long y = *(const long *) b;
+  return (x > y) - (x < y);
+}
+
+static void bench_mark(int stage, long usec) {
+
+  if (stage == BACKEND_MARK_INJECT) {
+    if (started == 0) {
+      started = usec;
+      round_trips = backend_round_trips();
+      requests = backend_fake_stats()->requests;
+    }
+    injected = usec;
+    memset(seen, 0, sizeof(seen));
+    return;
+  }
+
+  /* the first time each stage is reached after a key press */
+  if (injected == 0 || seen[stage])
+    return;
+
+  seen[stage] = True;
+  samples[stage][num_samples[stage]++] = usec - injected;
+}
+
+static void bench_report(void) {
+  FakeStats_t *stats = backend_fake_stats();
+  long *s;
+  int n;
+  int i;
+
+  for (i = BACKEND_MARK_RECEIPT; i < BACKEND_NUM_MARKS; i++) {
+    if ((n = num_samples[i]) == 0)
+      continue;
+
+    s = samples[i];
+    qsort(s, n, sizeof(long), bench_compare);
+
+    printf("%-10s %9d %-9s %6d %8ld %8ld %8ld\n",
+	   scenario, generated, stage_names[i], n,
+	   s[(n - 1) * 50 / 100], s[(n - 1) * 99 / 100], s[n - 1]);
+  }
+
+  printf("%-10s %9d %.2f round trips, %.2f requests per chord, "
+	 "%d keys dropped, %ld ms\n\n", scenario, generated,
+	 (double) (stats->round_trips - round_trips) / chords,
+	 (double) (stats->requests - requests) / chords,
+	 (int) stats->dropped, (bench_usec() - started) / 1000);
+  fflush(stdout);
+
+  exit(EXIT_SUCCESS);
+}
+
+static void bench_run(char *name, char *config, int size, char *script,
+		      int n) {
+  pid_t pid;
+  int status;
+  int i;
+
+  fflush(stdout);
+
+  /* every scenario gets a fresh daemon */
+  if ((pid = fork()) == -1) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+
+  if (pid > 0) {
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "%s: error: scenario '%s' failed\n", PACKAGE_NAME,
+	      name);
+      fflush(stderr);
+    }
+    return;
+  }
+
+  scenario = name;
+  generated = size;
+  chords = n;
+
+  for (i = 0; i < BACKEND_NUM_MARKS; i++)
+    samples[i] = (long *) calloc(FAKE_MAX_SCRIPT, sizeof(long));
+
+  xc = xc_new();
+  strncpy(xc->config, config, 4095);
+
+  xc_open_display(xc);
+  xc_parse_config(xc);
+
+  backend_fake_on_mark(bench_mark);
+  backend_fake_on_idle(bench_report);
+
+  if (!backend_fake_script(script)) {
+    fprintf(stderr, "%s: error: invalid script for '%s'\n", PACKAGE_NAME,
+	    name);
+    exit(EXIT_FAILURE);
+  }
+
+  xc_mainloop(xc);
+  exit(EXIT_SUCCESS);
+}
+
+static void bench_config(char *example, int size, int n) {
+  char *script = (char *) calloc(n * 64 + 64, sizeof(char));
+  char last[64];
+  char *config;
+  int i;
+
+  config = bench_write_config(example, size, last);
+
+  /* a two key chord */
+  script[0] = '\0';
+  for (i = 0; i < n; i++)
+    strcat(script, "C-t Return ");
+  bench_run("chord", config, size, script, n);
+
+  /* repeating a group binding */
+  strcpy(script, "C-t v ");
+  for (i = 0; i < n; i++)
+    strcat(script, "v ");
+  strcat(script, "Escape");
+  bench_run("group", config, size, script, n);
+
+  /* the last of the generated bindings */
+  if (size > 0) {
+    script[0] = '\0';
+    for (i = 0; i < n; i++) {
+      strcat(script, "C-t ");
+      strcat(script, last);
+      strcat(script, " ");
+    }
+    bench_run("deep", config, size, script, n);
+  }
+
+  unlink(config);
+  free(script);
+}
+
+static void bench_parse(int width) {
+  char *config = bench_write_chain(width);
+  pid_t pid;
+  long start, usec;
+  int status;
+
+  fflush(stdout);
+
+  /* every width gets a fresh daemon */
+  if ((pid = fork()) == -1) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+
+  if (pid > 0) {
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "%s: error: parsing width %d failed\n", PACKAGE_NAME,
+	      width);
+      fflush(stderr);
+    }
+    unlink(config);
+    return;
+  }
+
+  xc = xc_new();
+  strncpy(xc->config, config, 4095);
+  xc_open_display(xc);
+
+  start = bench_usec();
+  xc_parse_config(xc);
+  usec = bench_usec() - start;
+
+  printf("%-10s %9d %10.3f %12.3f\n", "parse", width, usec / 1000.0,
+	 (width > 0) ? (double) usec / width : 0.0);
+  fflush(stdout);
+
+  exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv) {
+  char *sizes = "0,1000,10000";
+  char *widths = NULL;
+  char *size;
+  int n = BENCH_CHORDS;
+  int option;
+
+  while ((option = getopt(argc, argv, "hn:p:s:")) != -1) {
+    switch (option) {
+    case 'n':
+      n = atoi(optarg);
+      break;
+    case 's':
+      sizes = optarg;
+      break;
+    case 'p':
+      widths = optarg;
+      break;
+    default:
+      bench_usage();
+      exit((option == 'h') ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+
+  if (widths != NULL) {
+    printf("%-10s %9s %10s %12s\n", "scenario", "width", "parse_ms",
+	   "us_per_key");
+
+    widths = strdup(widths);
+    for (size = strtok(widths, ","); size != NULL; size = strtok(NULL, ","))
+      bench_parse(atoi(size));
+
+    free(widths);
+    exit(EXIT_SUCCESS);
+  }
+
+  if (optind != argc - 1) {
+    bench_usage();
+    exit(EXIT_FAILURE);
+  }
+
+  /* every chord of the deep scenario takes up to 17 keys */
+  if (n < 1 || n > FAKE_MAX_SCRIPT / 17) {
+    fprintf(stderr, "%s: error: -n must be between 1 and %d\n",
+	    PACKAGE_NAME, FAKE_MAX_SCRIPT / 17);
+    exit(EXIT_FAILURE);
+  }
+
+  printf("%-10s %9s %-9s %6s %8s %8s %8s\n", "scenario", "generated",
+	 "stage", "keys", "p50_us", "p99_us", "max_us");
+
+  sizes = strdup(sizes);
+  for (size = strtok(sizes, ","); size != NULL; size = strtok(NULL, ","))
+    bench_config(argv[optind], atoi(size), n);
+
+  free(sizes);
+  exit(EXIT_SUCCESS);
+}
@@ -4,36 +4,55 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
 #include <unistd.h>
-#include <sys/wait.h>
-#include <sys/select.h>
+#include <sys/types.h>
 #include <string.h>
 #include <X11/Xlib.h>
 
+#include "arena.h"
 #include "key.h"
 #include "binding.h"
+#include "automaton.h"
 #include "popup.h"
+#include "loop.h"
+#include "launcher.h"
+#include "stats.h"
+#include "log.h"
+#include "backend.h"
 #include "util.h"
 #include "xchainkeys.h"
 
 extern XChainKeys_t *xc;
 
-Binding_t* binding_new() {
-  Binding_t *self = (Binding_t *) calloc(1, sizeof(Binding_t));
+Binding_t* binding_new(Arena_t *arena) {
+  Binding_t *self = (Binding_t *) arena_alloc(arena, sizeof(Binding_t));
 
   self->key = NULL;
   self->action = XC_ACTION_ENTER;
 
-  self->name = calloc(128, sizeof(char));
-  strcpy(self->name, "default");
-
-  self->argument = calloc(4096, sizeof(char));
+  /* the strings belong to the arena as well, so the defaults can be
+   * shared */
+  self->name = "default";
+  self->argument = "";
+  self->command = self->argument;
+  self->keyspec = "";
+  self->path = "";
   
   self->timeout = 3000; 
   self->abort = XC_ABORT_AUTO;
+  self->rate = 0;
+  self->coalesce = False;
+  self->last_exec = 0;
+  self->stats = NULL;
 
   self->parent = NULL;
   self->num_children = 0;
+  self->max_children = 0;
+  self->children = NULL;
+  self->index_size = 0;
+  self->index = NULL;
+  self->state = -1;
 
   return self;
 }
@@ -59,87 +78,95 @@ void binding_set_action(Binding_t *self, char *str) {
   }
 }
 
-void binding_parse_arguments(Binding_t *self) {
+void binding_parse_arguments(Binding_t *self, Arena_t *arena, int timeout) {
 
   char *argument;
-  char *argument_ptr;
-  char *value;
-  char *value_ptr;
-
   char *ws = " \t";
+  int len;
   int i;
   
   if(self->action == XC_ACTION_ENTER)
-    self->timeout = xc->timeout;
+    self->timeout = timeout;
 
   if(self->action != XC_ACTION_ENTER)
     self->abort = XC_ABORT_MANUAL;
     
-  argument = (char *) calloc(strlen(self->argument)+1, sizeof(char));
-  argument_ptr = argument;
-    
-  strncpy(argument, self->argument, strlen(self->argument)+1);
-  
+  argument = self->argument;
+
+  /* options come first, the command to run starts at the first word
+   * that isn't one, so that words of the command are never taken for
+   * options */
   while(strlen(argument)) {
 
     if(self->action == XC_ACTION_ENTER) { // parse timeout value only for :enter
     
       if(strncmp(argument, "timeout=", 8) == 0) {
+	argument += 8;
+	self->timeout = atoi(argument);
 	
-	value = (char *) calloc(strlen(argument)+1, sizeof(char));
-	value_ptr = value;
-	
-	strncpy(value, argument, strlen(argument)+1);
-	value += 8;
-	value[strcspn(value, ws)] = '\0';
-	
-	self->timeout = atoi(value);
-	
-	argument += 8 + strlen(value);
+	argument += strcspn(argument, ws);
 	argument += strspn(argument, ws);
-	
-	free(value_ptr);
 	continue;
       }
     }
     
     if(strncmp(argument, "abort=", 6) == 0) { // parse abort for any action
+      argument += 6;
+      len = strcspn(argument, ws);
       
-      value = (char *) calloc(strlen(argument)+1, sizeof(char));
-      value_ptr = value;
-      
-      strncpy(value, argument, strlen(argument)+1);
-      value += 6;
-      value[strcspn(value, ws)] = '\0';
-      
-      if(strcmp(value, "auto") == 0) 
+      if(len == 4 && strncmp(argument, "auto", 4) == 0) 
 	self->abort = XC_ABORT_AUTO;
       
-      if(strcmp(value, "manual") == 0)
+      if(len == 6 && strncmp(argument, "manual", 6) == 0)
 	self->abort = XC_ABORT_MANUAL;
       
-      argument += 6 + strlen(value);
+      argument += len;
+      argument += strspn(argument, ws);
+      continue;
+    }
+
+    if(strncmp(argument, "rate=", 5) == 0) { // parse rate for any action
+      argument += 5;
+      self->rate = atoi(argument);
+
+      argument += strcspn(argument, ws);
       argument += strspn(argument, ws);
+      continue;
+    }
+
+    if(strncmp(argument, "coalesce=", 9) == 0) { // parse coalesce for any action
+      argument += 9;
+      len = strcspn(argument, ws);
+      
+      if(len == 2 && strncmp(argument, "on", 2) == 0) 
+	self->coalesce = True;
       
-      free(value_ptr);
+      if(len == 3 && strncmp(argument, "off", 3) == 0)
+	self->coalesce = False;
+      
+      argument += len;
+      argument += strspn(argument, ws);
       continue;
     }
-    /* skip unparsed words */
-    argument += strcspn(argument, ws);      
-    argument += strspn(argument, ws);      
-    
-    if(strcspn(argument, ws) == 0)
-      break;
+
+    break;
   }
-  free(argument_ptr);
+  self->command = argument;
+
+  /* split simple commands into words and look up their executable
+   * once, so they can be run without a shell */
+  if(self->action == XC_ACTION_EXEC || self->action == XC_ACTION_GROUP ||
+     self->action == XC_ACTION_WAIT)
+    self->argv = launcher_parse_command(self->command, &self->executable, 
+					arena);
 
   /* recurse into children and parse their arguments as well */
   for( i=0; i<self->num_children; i++ ) {
-    binding_parse_arguments(self->children[i]);
+    binding_parse_arguments(self->children[i], arena, timeout);
   }
 }
 
-void binding_create_default_bindings(Binding_t *self) {
+void binding_create_default_bindings(Binding_t *self, Arena_t *arena) {
 
   Binding_t *binding;
   Key_t *key;
@@ -151,71 +178,151 @@ void binding_create_default_bindings(Binding_t *self) {
     /* create default :escape binding unless present */
     if (!binding_get_child_by_action(self, XC_ACTION_ESCAPE)) {
 
-      keyspec = key_to_str(self->key);
-      key = key_new(keyspec);
+      key = (Key_t *) arena_alloc(arena, sizeof(Key_t));
+      *key = *self->key;
 
       if(!binding_get_child_by_key(self, key)) {
 	
-	binding = binding_new();
+	binding = binding_new(arena);
 	binding->key = key;
 	binding->action = XC_ACTION_ESCAPE;
 
-	binding_append_child(self, binding);
+	binding_append_child(self, binding, arena);
       }
       else {
+	keyspec = key_to_str(self->key);
 	fprintf(stderr, 
 		"%s: chain '%s': :escape action not found and '%s %s' "  
 		"already bound:\n" 
 		"%s: -> skipping creation of default :escape binding...\n",
 		PACKAGE_NAME, keyspec, keyspec, keyspec, PACKAGE_NAME);
 	fflush(stderr);
-	free(key);
+	free(keyspec);
       }	
-      free(keyspec);
     }
     
     /* create default :abort binding unless present */
     if (!binding_get_child_by_action(self, XC_ACTION_ABORT)) {
       
-      keyspec = key_to_str(self->key);
-      key = key_new("C-g");
+      key = (Key_t *) arena_alloc(arena, sizeof(Key_t));
+      key_parse_keyspec(key, "C-g");
 
       if(!binding_get_child_by_key(self, key)) {
 	
-	binding = binding_new();
+	binding = binding_new(arena);
 	binding->key = key;
 	binding->action = XC_ACTION_ABORT;
 
-	binding_append_child(self, binding);
+	binding_append_child(self, binding, arena);
       }
       else {
+	keyspec = key_to_str(self->key);
 	fprintf(stderr, 
 		"%s: chain '%s': :abort action not found and '%s C-g' "  
 		"already bound:\n" 
 		"%s: -> skipping creation of default :abort binding...\n",
 		PACKAGE_NAME, keyspec, keyspec, PACKAGE_NAME);
 	fflush(stderr);
-	free(key);
+	free(keyspec);
       }
-      free(keyspec);
     }
   }
   
   /* recurse children */
   for (i=0; i<self->num_children; i++) {
-    binding_create_default_bindings(self->children[i]);
+    binding_create_default_bindings(self->children[i], arena);
   }
 
 }
 
-void binding_append_child(Binding_t *self, Binding_t *child) {
+void binding_append_child(Binding_t *self, Binding_t *child, Arena_t *arena) {
+
+  /* grow the child array as needed, most bindings have no or only a
+   * few children */
+  if(self->num_children == self->max_children) {
+    self->max_children = (self->max_children == 0) ? 4 : self->max_children * 2;
+    self->children = (Binding_t **) 
+      arena_realloc(arena, self->children,
+		    self->num_children * sizeof(Binding_t *),
+		    self->max_children * sizeof(Binding_t *));
+  }
+
   self->children[self->num_children] = child;
   child->parent = self;
   self->num_children += 1;
+
+  /* keep the hash index of wide bindings up to date, growing it
+   * before it gets more than half full */
+  if(self->index != NULL && self->num_children * 2 <= self->index_size)
+    binding_index_insert(self, self->num_children - 1);
+  else if(self->num_children > BINDING_INDEX_THRESHOLD)
+    binding_build_index(self, arena);
+}
+
+unsigned int binding_hash_key(Key_t *key) {
+  unsigned int code = (key->keycode != 0) ? key->keycode : key->keysym;
+  return ((code << 8) | (key->modifiers & XC_MODIFIERS)) * 2654435761u;
+}
+
+void binding_index_insert(Binding_t *self, int child) {
+
+  /* the index is an open addressing table of child positions plus
+   * one, with zero marking a free slot */
+
+  Key_t *key = self->children[child]->key;
+  unsigned int mask = self->index_size - 1;
+  unsigned int slot = binding_hash_key(key) & mask;
+
+  while(self->index[slot] != 0) {
+
+    /* the first child bound to a key wins, as with a linear search */
+    if(key_equals(self->children[self->index[slot]-1]->key, key))
+      return;
+
+    slot = (slot + 1) & mask;
+  }
+  self->index[slot] = child + 1;
+}
+
+void binding_build_index(Binding_t *self, Arena_t *arena) {
+  int size = 16;
+
+  while(size < self->num_children * 4)
+    size *= 2;
+
+  self->index = (int *) arena_alloc(arena, size * sizeof(int));
+  self->index_size = size;
+
+  binding_reindex(self);
+}
+
+void binding_reindex(Binding_t *self) {
+  int i;
+
+  memset(self->index, 0, self->index_size * sizeof(int));
+
+  for( i=0; i<self->num_children; i++ ) {
+    binding_index_insert(self, i);
+  }
 }
 
 Binding_t *binding_get_child_by_key(Binding_t *self, Key_t *key) {
+  unsigned int mask;
+  unsigned int slot;
   int i;
+
+  if(self->index != NULL) {
+    mask = self->index_size - 1;
+    slot = binding_hash_key(key) & mask;
+
+    while(self->index[slot] != 0) {
+      if (key_equals(self->children[self->index[slot]-1]->key, key))
+	return self->children[self->index[slot]-1];
+      slot = (slot + 1) & mask;
+    }
+    return NULL;
+  }
+
   for( i=0; i<self->num_children; i++ ) {
     if (key_equals(self->children[i]->key, key))
       return self->children[i];
@@ -232,15 +339,153 @@ Binding_t *binding_get_child_by_action(Binding_t *self, int action) {
   return NULL;
 }
 
-void binding_activate(Binding_t *self) {
-  char *path;
-  path = binding_to_path(self);
+int binding_lookup(Binding_t *self, Key_t *key, Transition_t *transition) {
 
-  if (xc->debug) {
-    printf(" -> %s %s %s\n", 
-	   path, xc->action_names[self->action], self->argument);
-    fflush(stdout);
+  /* find the binding for a key within this chain, using the compiled
+   * automaton if available */
+
+  Transition_t *found;
+  Binding_t *binding;
+
+  if(xc->automaton != NULL && self->state >= 0) {
+    found = automaton_lookup(xc->automaton, self->state, key);
+
+    if(found == NULL)
+      return False;
+
+    *transition = *found;
+    return True;
+  }
+
+  if((binding = binding_get_child_by_key(self, key)) == NULL)
+    return False;
+
+  automaton_set_transition(transition, binding);
+  return True;
+}
+
+void binding_compute_paths(Binding_t *self, Arena_t *arena) {
+
+  /* store the keyspec of each binding and its path from the top
+   * level, e.g. "C-t x (name) a", as shown by the popup, the debug
+   * output and binding_list() */
+
+  char keyspec[KEY_STR_SIZE];
+  size_t len;
+  int i;
+
+  if(self->key != NULL) {
+    key_format(self->key, keyspec);
+    self->keyspec = arena_strdup(arena, keyspec);
+
+    len = strlen(self->parent->path) + strlen(keyspec) + strlen(self->name) + 5;
+    self->path = (char *) arena_alloc(arena, len);
+
+    if(strlen(self->parent->path) > 0)
+      snprintf(self->path, len, "%s %s", self->parent->path, keyspec);
+    else
+      snprintf(self->path, len, "%s", keyspec);
+
+    if(strcmp(self->name, "default") != 0) {
+      strcat(self->path, " (");
+      strcat(self->path, self->name);
+      strcat(self->path, ")");
+    }
   }
+
+  for( i=0; i<self->num_children; i++ ) {
+    binding_compute_paths(self->children[i], arena);
+  }
+}
+
+void binding_attach_stats(Binding_t *self, Stats_t *stats) {
+  int i;
+
+  /* counters are kept by path, so they outlive the binding */
+  if(self->key != NULL)
+    self->stats = stats_lookup(stats, self->path);
+
+  for( i=0; i<self->num_children; i++ ) {
+    binding_attach_stats(self->children[i], stats);
+  }
+}
+
+void binding_resolve_keys(Binding_t *self) {
+  int i;
+
+  /* refresh the cached keycodes of the whole tree after the keyboard
+   * mapping has changed */
+
+  if(self->key != NULL)
+    key_resolve(self->key);
+
+  for( i=0; i<self->num_children; i++ ) {
+    binding_resolve_keys(self->children[i]);
+  }
+
+  /* the children's keycodes may have changed */
+  if(self->index != NULL)
+    binding_reindex(self);
+}
+
+int binding_remove_duplicates(Binding_t *self) {
+  Binding_t *child;
+  Binding_t *first;
+  char *drop;
+  int errors = 0;
+  int kept = 0;
+  int i;
+
+  /* keys are only told apart by their keysym while parsing, so two
+   * keysyms on the same key, or a keysym and the numeric keycode of
+   * its key, can both end up in a chain. Once their keycodes are
+   * resolved, drop each such child after the first one, which is the
+   * one that would be found for the key anyway, and count it */
+
+  if(self->num_children == 0)
+    return 0;
+
+  /* decide first, the lookups need the children where they are */
+  drop = (char *) calloc(self->num_children, sizeof(char));
+
+  for( i=0; i<self->num_children; i++ ) {
+    child = self->children[i];
+    first = binding_get_child_by_key(self, child->key);
+
+    if(first != child) {
+      fprintf(stderr, "%s: '%s': already bound as '%s', skipping...\n",
+	      PACKAGE_NAME, child->path, first->path);
+      fflush(stderr);
+      drop[i] = True;
+      errors++;
+    }
+  }
+
+  if(errors > 0) {
+    for( i=0; i<self->num_children; i++ ) {
+      if(!drop[i])
+	self->children[kept++] = self->children[i];
+    }
+    self->num_children = kept;
+
+    if(self->index != NULL)
+      binding_reindex(self);
+  }
+  free(drop);
+
+  for( i=0; i<self->num_children; i++ ) {
+    errors += binding_remove_duplicates(self->children[i]);
+  }
+  return errors;
+}
+
+void binding_activate(Binding_t *self) {
+
+  backend_mark(BACKEND_MARK_DISPATCH);
+  self->stats->activations++;
+
+  log_printf(xc->log, LOG_LEVEL_DEBUG, " -> %s %s %s\n", 
+	     self->path, xc->action_names[self->action], self->argument);
   
   switch(self->action) {
 
@@ -270,138 +515,139 @@ void binding_activate(Binding_t *self) {
     xc->reload = True;
     break;
   }
-  free(path);
 }
 
-int binding_wait_event(Binding_t *self) {
-    struct timeval tv1, tv2, *delay_tv, *timeout_tv;
-    fd_set in;
-    int ignore_delay = False;
-
-    if (xc->delay > 0) {
-        if (self->timeout > 0 && xc->delay > self->timeout) {
-            ignore_delay = True;
-            delay_tv = NULL;
-        } else {
-            tv1.tv_sec = xc->delay / 1000;
-            tv1.tv_usec = (xc->delay % 1000) * 1000;
-            delay_tv = &tv1;
-        }
-    } else {
-        delay_tv = NULL;
-    }
+int binding_wait_event(Binding_t *self, LoopTimer_t *timeout) {
 
-    if (self->timeout > 0) {
-        if (ignore_delay) {
-            tv2.tv_sec = self->timeout / 1000;
-            tv2.tv_usec = (self->timeout % 1000) * 1000;
-        } else {
-            tv2.tv_sec = (self->timeout - xc->delay) / 1000;
-            tv2.tv_usec = (self->timeout - xc->delay) % 1000 * 1000;
-        }
-        timeout_tv = &tv2;
-    } else {
-        timeout_tv = NULL;
-    }
+  /* wait for the next X event until the chain times out, the popup is
+   * shown by its delay timer in the meantime */
+  while(!events_pending(xc->display)) {
+    if (timeout->fired)
+      return False;
+    loop_wait(xc->loop);
+  }
+  return True;
+}
 
-    FD_ZERO(&in);
-    FD_SET(xc->connection, &in);
+void binding_arm_timers(Binding_t *self, LoopTimer_t *timeout) {
 
-    if (ignore_delay) {
-        return select(xc->connection + 1, &in, 0, 0, timeout_tv);
-    } else {
-        if (delay_tv
-            && select(xc->connection + 1, &in, 0, 0, delay_tv)) {
-            return 1;
-        }
+  if (self->timeout > 0)
+    loop_arm(xc->loop, timeout, self->timeout * 1000L);
+  else
+    loop_disarm(xc->loop, timeout);
 
-        if(!xc->popup->mapped)
-            popup_show(xc->popup);
+  if (xc->popup->mapped)
+    return;
 
-        if (!FD_ISSET(xc->connection, &in))
-            FD_SET(xc->connection, &in);
-        return select(xc->connection + 1, &in, 0, 0, timeout_tv);
-    }
+  if (xc->delay > 0)
+    loop_arm(xc->loop, xc->delay_timer, xc->delay * 1000L);
+  else
+    popup_show(xc->popup);
 }
 
 void binding_enter(Binding_t *self) {
   XEvent event;
   KeyCode keycode;
-  Binding_t *binding;
-  Key_t *key;
-  char *keystr;
-  char *keyspec;
+  Transition_t transition;
+  int found;
+  Key_t key;
+  char keyspec[KEY_STR_SIZE];
+  unsigned long allocs;
+  LoopTimer_t timeout;
   int done = False;
-  char *path = binding_to_path(self);
+
+  self->stats->entries++;
 
   /* prepare popup */
-  strncpy(xc->popup->text, path, 4096);
+  xc->popup->text = self->path;
 
   if(xc->popup->mapped)
     popup_show(xc->popup);
 
+  /* the chain times out if no key is handled for its timeout, and the
+   * popup is shown after the delay */
+  loop_timer_init(&timeout, NULL, NULL);
+  binding_arm_timers(self, &timeout);
+
   /* get exclusive grab on keyboard... */
   if (self->parent == xc->root) {
-    XGrabKeyboard(xc->display, DefaultRootWindow(xc->display),
-		  True, GrabModeAsync, GrabModeAsync, CurrentTime);
+    backend_grab_keyboard(xc->display);
+    xc->stats->keyboard_grabs++;
   }
+  stats_latency(self->stats, get_usec() - xc->event_usec);
 
   while(!done) {    
-      if (!binding_wait_event(self)) {
-          if (xc->debug) { printf("Timed out\n"); fflush(stdout); }
+      if (!binding_wait_event(self, &timeout)) {
+          self->stats->timeouts++;
+          log_printf(xc->log, LOG_LEVEL_DEBUG, "Timed out\n");
           done = True;
           continue;
       }
 
     /* look for key press events... */
-    if(XPending(xc->display)) {
-      XNextEvent(xc->display, &event);
+    if(backend_events_queued(xc->display) > 0) {
+      backend_next_event(xc->display, &event);
+      xc->event_usec = get_usec();
+      xc->repeat = is_autorepeat(&event);
+      xc->stats->events++;
+      allocs = get_allocs();
       
       /* dispatch exec, abort or escape */
       if(event.type == KeyPress) {
 
-	/* get keycode and keystr */
+	/* get keycode */
 	keycode = ((XKeyPressedEvent*)&event)->keycode;
-	keystr = XKeysymToString(XKeycodeToKeysym(xc->display, keycode, 0));
 	
 	/* check if this key is a modifier */
-	if (keycode_to_modifier(xc->xmodmap, keycode) != 0) {
+	if (keycode_to_modifier(keycode) != 0) {
 	  continue;
 	}      
 	else {	
 	  /* non-modifier key hit... */
-	  key = key_new(keystr);
-	  key->modifiers = get_modifiers(xc->display);
+	  key_from_event(&key, &event.xkey);
 	  
 	  /* check if this key is bound in this keymap */
-	  if( (binding = binding_get_child_by_key(self, key)) != NULL) {
+	  if( (found = binding_lookup(self, &key, &transition)) ) {
+	    report_allocs("Key lookup", allocs);
 	    
 	    /* :abort from here... */
-	    if (binding->action == XC_ACTION_ABORT) {
-	      if (xc->debug) { printf("Aborted\n"); fflush(stdout); }
+	    if (transition.action == XC_ACTION_ABORT) {
+	      self->stats->aborts++;
+	      log_printf(xc->log, LOG_LEVEL_DEBUG, "Aborted\n");
 	      done = True;
-	      free(key);
 	      continue;
 	    }
 	    
 	    /* ... or activate the binding */
-	    binding_activate(binding);
+	    binding_activate(transition.binding);
+
+	    /* a prefix key was hit while a :wait command was running,
+	     * leave all chains to enter the new one */
+	    if(xc->unwind) {
+	      done = True;
+	      continue;
+	    }
 
 	    /* check if the binding overrides abort in a manual chain */
-	    if(self->abort == XC_ABORT_MANUAL && binding->abort == XC_ABORT_AUTO)
+	    if(self->abort == XC_ABORT_MANUAL && 
+	       transition.abort == XC_ABORT_AUTO)
 	      done = True;
 	  }
 	  else {
-	    keyspec = key_to_str(key);
-	    sprintf(xc->popup->text, "%s %s: no binding", path, keyspec);
+	    self->stats->misses++;
+	    key_format(&key, keyspec);
+	    snprintf(xc->popup->buffer, sizeof(xc->popup->buffer), 
+		     "%s %s: no binding", self->path, keyspec);
+	    xc->popup->text = xc->popup->buffer;
+	    report_allocs("Key lookup", allocs);
+
 	    popup_show(xc->popup);
-	    xc->popup->timeout = (xc->hold == -1) ? xc->delay : xc->hold;
+	    if (((xc->hold == -1) ? xc->delay : xc->hold) > 0)
+	      loop_arm(xc->loop, xc->hold_timer, 
+		       ((xc->hold == -1) ? xc->delay : xc->hold) * 1000L);
 
-	    if (xc->debug) {
-	      printf(" -> %s %s: no binding\n", path, keyspec);
-	      fflush(stdout);
-	    }
-	    free(keyspec);
+	    log_printf(xc->log, LOG_LEVEL_DEBUG, " -> %s %s: no binding\n", 
+		       self->path, keyspec);
 	  }	
 
 	  /* done, exit this keymap unless manual abort was requested */
@@ -409,10 +655,12 @@ void binding_enter(Binding_t *self) {
 	    done = True;
 
 	  /* always exit if the prefix key was escaped */
-	  if (binding != NULL && binding->action == XC_ACTION_ESCAPE)
+	  if (found && transition.action == XC_ACTION_ESCAPE)
 	    done = True;
-	  
-	  free(key);
+
+	  /* the key was handled, start over */
+	  if (!done)
+	    binding_arm_timers(self, &timeout);
 	}
       }
     }
@@ -420,92 +668,84 @@ void binding_enter(Binding_t *self) {
   
   /* ungrab keyboard... */
   if (self->parent == xc->root) {
-    XUngrabKeyboard(xc->display, CurrentTime);
+    backend_ungrab_keyboard(xc->display);
   }
 
-  /* hide popup if no timeout is set for it */
-  if(xc->popup->timeout == 0)
-    popup_hide(xc->popup);
+  loop_disarm(xc->loop, &timeout);
+  loop_disarm(xc->loop, xc->delay_timer);
 
-  free(path);
+  /* hide popup unless it is held */
+  if(!xc->hold_timer->armed)
+    popup_hide(xc->popup);
 }
 
 void binding_escape(Binding_t *self) {
 
   Window window;
-  int focus_ret;
 
   if(self->parent == NULL)
     return;
 
-  XUngrabKeyboard(xc->display, CurrentTime);
-  XGetInputFocus(xc->display, &window, &focus_ret);
+  backend_ungrab_keyboard(xc->display);
+  window = backend_get_input_focus(xc->display);
 
   send_key(xc->display, self->parent->key, window);
 
-  XGrabKeyboard(xc->display, DefaultRootWindow(xc->display),
-		True, GrabModeAsync, GrabModeAsync, CurrentTime);
+  backend_grab_keyboard(xc->display);
+  xc->stats->keyboard_grabs++;
 }
 
 void binding_group(Binding_t *self) {
-  Key_t *key;
+  Key_t key;
   Binding_t *binding;
+  Transition_t transition;
   XEvent event;
   KeyCode keycode;
-  char *keystr;
-  int i;
   int abort = False;
-  char *path;
-  
-  path = binding_to_path(self->parent);
-  strncat(path, " (", 4096-strlen(path)-1);
-  strncat(path, self->name, 4096-strlen(path)-1);
-  strncat(path, ")", 4096-strlen(path)-1);
   
-  strncpy(xc->popup->text, path, 4096);
-  free(path);
+  snprintf(xc->popup->buffer, sizeof(xc->popup->buffer), 
+	   "%s (%s)", self->parent->path, self->name);
+  xc->popup->text = xc->popup->buffer;
 
   popup_show(xc->popup);
   binding_exec(self);
 
   while(True) {
-    XNextEvent(xc->display, &event);
+    while(!events_pending(xc->display))
+      loop_wait(xc->loop);
+
+    backend_next_event(xc->display, &event);
+    xc->event_usec = get_usec();
+    xc->repeat = is_autorepeat(&event);
+    xc->stats->events++;
     
     switch(event.type) {
     case KeyPress:
       
-      /* get keycode and keystr */
+      /* get keycode */
       keycode = ((XKeyPressedEvent*)&event)->keycode;
-      keystr = XKeysymToString(XKeycodeToKeysym(xc->display, keycode, 0));
       
       /* check if this key is a modifier */
-      if (keycode_to_modifier(xc->xmodmap, keycode) != 0) {
+      if (keycode_to_modifier(keycode) != 0) {
 	break;
       }      
       else {	
 	/* non-modifier key hit... */
-	key = key_new(keystr);
-	key->modifiers = get_modifiers(xc->display);
+	key_from_event(&key, &event.xkey);
 	
 	/* :exec any :group actions of the same name in the parent
 	 * binding, and abort on any non-repeating key
 	 */
-	for(i=0; i<self->parent->num_children; i++) {
-	  binding = self->parent->children[i];
-	  
-	  if ( binding->action == XC_ACTION_GROUP &&
-	       strcmp(binding->name, self->name) == 0 &&
-	       key_equals(binding->key, key) ) {
+	abort = True;
 
-	    binding_exec(binding);
-	    
-	    if(binding->action != XC_ACTION_ESCAPE)
-	      abort = False;
-	    if(binding->abort == XC_ABORT_AUTO)
-	      abort = True;
-	    break;
-	  }
-	  abort = True;
+	if ( binding_lookup(self->parent, &key, &transition) &&
+	     transition.action == XC_ACTION_GROUP &&
+	     strcmp(transition.name, self->name) == 0 ) {
+
+	  backend_mark(BACKEND_MARK_DISPATCH);
+	  transition.binding->stats->activations++;
+	  binding_exec(transition.binding);
+	  abort = (transition.abort == XC_ABORT_AUTO);
 	}
 
 	if(abort) {
@@ -514,52 +754,89 @@ void binding_group(Binding_t *self) {
 	   * xc_mainloop()
 	   */
 
-	  for(i=0; i<xc->root->num_children; i++) {
-	    binding = xc->root->children[i];
-	    if ( binding->action == XC_ACTION_ENTER &&
-		 key_equals(binding->key, key) ) {
-	      xc->reentry = binding;
-	    }
-	  } 
-	  free(key);
+	  binding = xc_lookup_prefix(xc, keycode, key.modifiers);
+	  if (binding != NULL && binding->action == XC_ACTION_ENTER) {
+	    xc->reentry = binding;
+	  }
 	  return;
 	}
-	free(key);
       }
     }
   }
 }
 
 void binding_wait(Binding_t *self) {
-  char *command = self->argument;
+  Binding_t *binding;
+  XEvent event;
 
-  XUngrabKeyboard(xc->display, CurrentTime);
-  XFlush(xc->display);
+  backend_ungrab_keyboard(xc->display);
+  backend_flush(xc->display);
 
-  system(command);
+  if (launcher_watch(self->executable, self->argv, self->command, 
+		     self->path)) {
 
-  if (self->parent != xc->root)
-    XGrabKeyboard(xc->display, DefaultRootWindow(xc->display),
-		  True, GrabModeAsync, GrabModeAsync, CurrentTime);
+    /* keep handling X events and timers until the command exits,
+     * instead of blocking in system() */
+    while(!launcher_watch_done()) {
 
-  XFlush(xc->display);
+      while(events_pending(xc->display)) {
+	backend_next_event(xc->display, &event);
+	xc->event_usec = get_usec();
+	xc->repeat = is_autorepeat(&event);
+	xc->stats->events++;
+
+	if (event.type == MappingNotify) {
+	  xc_refresh_mapping(xc, &event.xmapping);
+	  xc_grab_prefix_keys(xc);
+	}
+
+	/* the keyboard isn't grabbed, so this is a prefix key: stop
+	 * waiting and enter its chain once all chains are left */
+	if (event.type == KeyPress) {
+	  binding = xc_lookup_prefix(xc, event.xkey.keycode,
+				     get_event_modifiers(&event.xkey));
+	  if (binding != NULL) {
+	    log_printf(xc->log, LOG_LEVEL_DEBUG, "Stopped waiting for '%s'\n", 
+		       self->command);
+	    launcher_unwatch();
+	    xc->reentry = binding;
+	    xc->unwind = True;
+	    return;
+	  }
+	}
+      }
+
+      loop_wait(xc->loop);
+    }
+    launcher_unwatch();
+  }
+
+  if (self->parent != xc->root) {
+    backend_grab_keyboard(xc->display);
+    xc->stats->keyboard_grabs++;
+  }
+
+  backend_flush(xc->display);
 }
 
 void binding_exec(Binding_t *self) {
-  pid_t pid;
-  char *command = self->argument;
-
-  if (!(pid = fork())) {
-    setsid();
-    switch (fork())
-      {
-      case 0: execlp ("sh", "sh", "-c", command, (char *) NULL);
-	break;
-      default: _exit(0);
-	break;
-      }
+  long now = get_usec();
+
+  /* cap the number of commands launched by the autorepeat of a held
+   * key */
+  if (xc->repeat && self->rate > 0 && 
+      now - self->last_exec < 1000000L / self->rate) {
+    log_printf(xc->log, LOG_LEVEL_DEBUG, "Skipped autorepeat of %s\n", 
+	       self->path);
+    return;
   }
-  if (pid > 0) wait(NULL);
+  self->last_exec = now;
+
+  launcher_exec(self->executable, self->argv, self->command, self->path, 
+		self->coalesce);
+
+  self->stats->launches++;
+  stats_latency(self->stats, get_usec() - xc->event_usec);
 }
 
 char *binding_to_path(Binding_t *self) {
@@ -592,7 +869,6 @@ char *binding_to_path(Binding_t *self) {
 
 void binding_list(Binding_t *self) {
   Binding_t *current;
-  char *keyspec;
   int depth = 0;
   int i;
   
@@ -605,16 +881,14 @@ void binding_list(Binding_t *self) {
     printf("    ");  
 
   if(depth > 0) {
-    keyspec = key_to_str(self->key);
-    
     if(strcmp(self->name, "default") == 0)
       printf("%s %s %s\n", 
-	     keyspec, xc->action_names[self->action], self->argument);
+	     self->keyspec, xc->action_names[self->action], self->argument);
     else 
       printf("%s %s \"%s\" %s\n", 
-	     keyspec, xc->action_names[self->action], self->name, self->argument);
+	     self->keyspec, xc->action_names[self->action], self->name, 
+	     self->argument);
     fflush(stdout);
-    free(keyspec);
   }
 
   for( i=0; i<self->num_children; i++ ) {
@@ -622,17 +896,90 @@ void binding_list(Binding_t *self) {
   }
 }
 
-void binding_free(Binding_t *self) {
+int binding_count(Binding_t *self) {
+  int count = 1;
   int i;
 
   for( i=0; i<self->num_children; i++ ) {
-    binding_free(self->children[i]);
-    self->children[i] = NULL;
+    count += binding_count(self->children[i]);
   }
-  self->num_children = 0;
-  self->parent = NULL;
-  free(self->name);
-  free(self->argument);
-  free(self->key);
-  free(self);
+  return count;
+}
+
+int binding_equals(Binding_t *self, Binding_t *binding) {
+
+  /* both bindings are reached by the same keys, compare what they do */
+  return self->action == binding->action &&
+    self->timeout == binding->timeout &&
+    self->abort == binding->abort &&
+    self->rate == binding->rate &&
+    self->coalesce == binding->coalesce &&
+    strcmp(self->name, binding->name) == 0 &&
+    strcmp(self->argument, binding->argument) == 0 &&
+    /* the executable found in PATH may have changed as well */
+    (self->executable == binding->executable ||
+     (self->executable != NULL && binding->executable != NULL &&
+      strcmp(self->executable, binding->executable) == 0));
+}
+
+int binding_diff(Binding_t *self, Binding_t *old) {
+  Binding_t *child;
+  int changes = 0;
+  int i;
+
+  /* count the bindings of this tree that were added or changed since
+   * the old one and those removed from it, and carry the state of the
+   * others over */
+
+  if(binding_equals(self, old))
+    self->last_exec = old->last_exec;
+  else
+    changes++;
+
+  for( i=0; i<self->num_children; i++ ) {
+    child = binding_get_child_by_key(old, self->children[i]->key);
+
+    if(child != NULL)
+      changes += binding_diff(self->children[i], child);
+    else
+      changes += binding_count(self->children[i]);
+  }
+
+  for( i=0; i<old->num_children; i++ ) {
+    if(binding_get_child_by_key(self, old->children[i]->key) == NULL)
+      changes += binding_count(old->children[i]);
+  }
+  return changes;
+}
+
+size_t binding_size(Binding_t *self) {
+
+  /* the number of bytes allocated for this binding and its children */
+
+  size_t size = sizeof(Binding_t);
+  int i;
+
+  size += self->max_children * sizeof(Binding_t *);
+  size += self->index_size * sizeof(int);
+  size += strlen(self->name) + 1;
+  size += strlen(self->argument) + 1;
+  size += strlen(self->keyspec) + 1;
+  size += strlen(self->path) + 1;
+
+  if(self->executable != NULL)
+    size += strlen(self->executable) + 1;
+
+  for( i=0; self->argv != NULL && self->argv[i] != NULL; i++ ) {
+    size += sizeof(char *) + strlen(self->argv[i]) + 1;
+  }
+  if(self->argv != NULL)
+    size += sizeof(char *);
+
+  if(self->key != NULL)
+    size += sizeof(Key_t);
+
+  for( i=0; i<self->num_children; i++ ) {
+    size += binding_size(self->children[i]);
+  }
+  return size;
 }
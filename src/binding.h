@@ -1,27 +1,57 @@
 #ifndef BINDING_H
 #define BINDING_H
 
+/* bindings with more children than this get a hash index */
+#define BINDING_INDEX_THRESHOLD 8
+
+struct Transition;
+struct LoopTimer;
+struct Stats;
+
 struct Binding {
   Key_t *key;
   int action;
   char *argument;
+  char *command;
+  char *executable;
+  char **argv;
   char *name;
+  char *keyspec;
+  char *path;
   int timeout;
   int abort;
+  int rate;
+  int coalesce;
+  long last_exec;
+  struct StatsPath *stats;
   struct Binding *parent;  
   int num_children;
-  struct Binding *children[1024];
+  int max_children;
+  struct Binding **children;
+  int index_size;
+  int *index;
+  int state;
 };
 typedef struct Binding Binding_t;
 
-Binding_t* binding_new();
+Binding_t* binding_new(Arena_t *arena);
 void binding_set_action(Binding_t *self, char *str);
-void binding_parse_arguments(Binding_t *self);
-void binding_create_default_bindings(Binding_t *self);
-void binding_append_child(Binding_t *self, Binding_t *child);
+void binding_parse_arguments(Binding_t *self, Arena_t *arena, int timeout);
+void binding_create_default_bindings(Binding_t *self, Arena_t *arena);
+void binding_append_child(Binding_t *self, Binding_t *child, Arena_t *arena);
+unsigned int binding_hash_key(Key_t *key);
+void binding_index_insert(Binding_t *self, int child);
+void binding_build_index(Binding_t *self, Arena_t *arena);
+void binding_reindex(Binding_t *self);
 Binding_t *binding_get_child_by_key(Binding_t *self, Key_t *key);
 Binding_t *binding_get_child_by_action(Binding_t *self, int action);
-int binding_wait_event(Binding_t *self);
+int binding_lookup(Binding_t *self, Key_t *key, struct Transition *transition);
+void binding_resolve_keys(Binding_t *self);
+int binding_remove_duplicates(Binding_t *self);
+void binding_compute_paths(Binding_t *self, Arena_t *arena);
+void binding_attach_stats(Binding_t *self, struct Stats *stats);
+void binding_arm_timers(Binding_t *self, struct LoopTimer *timeout);
+int binding_wait_event(Binding_t *self, struct LoopTimer *timeout);
 void binding_activate(Binding_t *self);
 void binding_enter(Binding_t *self);
 void binding_escape(Binding_t *self);
@@ -31,6 +61,9 @@ void binding_wait(Binding_t *self);
 void binding_group(Binding_t *self);
 char *binding_to_path(Binding_t *self);
 void binding_list(Binding_t *self);
-void binding_free(Binding_t *self);
+int binding_count(Binding_t *self);
+int binding_equals(Binding_t *self, Binding_t *binding);
+int binding_diff(Binding_t *self, Binding_t *old);
+size_t binding_size(Binding_t *self);
 
 #endif /* #ifndef BINDING_H */
@@ -0,0 +1,134 @@
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 500
+#endif /* _XOPEN_SOURCE */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <X11/Xlib.h>
+
+#include "arena.h"
+#include "key.h"
+#include "binding.h"
+#include "grab.h"
+#include "loop.h"
+#include "stats.h"
+#include "log.h"
+#include "backend.h"
+#include "xchainkeys.h"
+
+extern XChainKeys_t *xc;
+
+GrabSet_t* grab_set_new() {
+  GrabSet_t *self = (GrabSet_t *) calloc(1, sizeof(GrabSet_t));
+
+  self->grabs = NULL;
+  self->num_grabs = 0;
+  self->dirty = True;
+
+  return self;
+}
+
+int grab_set_contains(Grab_t *grabs, int num_grabs, Grab_t *grab) {
+  int i;
+  for( i=0; i<num_grabs; i++ ) {
+    if(grabs[i].keycode == grab->keycode &&
+       grabs[i].modifiers == grab->modifiers)
+      return True;
+  }
+  return False;
+}
+
+void grab_set_grab(GrabSet_t *self, Grab_t *grab) {
+  int i;
+
+  for( i=0; i<8; i++ ) {
+    backend_grab_key(xc->display, grab->keycode, 
+		     grab->modifiers | self->modmask[i]);
+    xc->stats->key_grabs++;
+  }
+}
+
+void grab_set_ungrab(GrabSet_t *self, Grab_t *grab) {
+  int i;
+
+  for( i=0; i<8; i++ ) {
+    backend_ungrab_key(xc->display, grab->keycode, 
+		       grab->modifiers | self->modmask[i]);
+  }
+}
+
+void grab_set_sync(GrabSet_t *self, Binding_t *root) {
+
+  /* bring the passive grabs on the root window in line with the
+   * prefix keys of the binding tree. Only the keys that have been
+   * added or removed since the last sync are (un)grabbed, so this is
+   * a no-op unless the tree, the keymap or the lock modifiers have
+   * changed. */
+
+  Grab_t *wanted;
+  Grab_t grab;
+  int num_wanted = 0;
+  int i;
+
+  if(!self->dirty)
+    return;
+
+  /* the lock modifiers have changed, so all existing grabs are stale */
+  if(memcmp(self->modmask, xc->modmask, sizeof(self->modmask)) != 0) {
+    grab_set_release(self);
+    memcpy(self->modmask, xc->modmask, sizeof(self->modmask));
+  }
+
+  wanted = (Grab_t *) calloc(root->num_children+1, sizeof(Grab_t));
+
+  for( i=0; i<root->num_children; i++ ) {
+    grab.keycode = key_get_keycode(root->children[i]->key);
+    grab.modifiers = root->children[i]->key->modifiers;
+
+    if(grab.keycode == 0)
+      continue;
+
+    if(!grab_set_contains(wanted, num_wanted, &grab))
+      wanted[num_wanted++] = grab;
+  }
+
+  /* release grabs that are no longer needed */
+  for( i=0; i<self->num_grabs; i++ ) {
+    if(!grab_set_contains(wanted, num_wanted, &self->grabs[i]))
+      grab_set_ungrab(self, &self->grabs[i]);
+  }
+
+  /* grab keys that are not grabbed yet */
+  for( i=0; i<num_wanted; i++ ) {
+    if(!grab_set_contains(self->grabs, self->num_grabs, &wanted[i]))
+      grab_set_grab(self, &wanted[i]);
+  }
+
+  free(self->grabs);
+  self->grabs = wanted;
+  self->num_grabs = num_wanted;
+  self->dirty = False;
+
+  log_printf(xc->log, LOG_LEVEL_INFO, "Grabbed %d prefix keys\n", 
+	     self->num_grabs);
+}
+
+void grab_set_invalidate(GrabSet_t *self) {
+  self->dirty = True;
+}
+
+void grab_set_release(GrabSet_t *self) {
+  int i;
+
+  for( i=0; i<self->num_grabs; i++ ) {
+    grab_set_ungrab(self, &self->grabs[i]);
+  }
+  self->num_grabs = 0;
+  self->dirty = True;
+}
+
+void grab_set_free(GrabSet_t *self) {
+  free(self->grabs);
+  free(self);
+}
@@ -0,0 +1,25 @@
+#ifndef GRAB_H
+#define GRAB_H
+
+typedef struct Grab {
+  unsigned int keycode;
+  unsigned int modifiers;
+} Grab_t;
+
+typedef struct GrabSet {
+  Grab_t *grabs;
+  int num_grabs;
+  int modmask[8];
+  int dirty;
+} GrabSet_t;
+
+GrabSet_t* grab_set_new(void);
+int grab_set_contains(Grab_t *grabs, int num_grabs, Grab_t *grab);
+void grab_set_grab(GrabSet_t *self, Grab_t *grab);
+void grab_set_ungrab(GrabSet_t *self, Grab_t *grab);
+void grab_set_sync(GrabSet_t *self, Binding_t *root);
+void grab_set_invalidate(GrabSet_t *self);
+void grab_set_release(GrabSet_t *self);
+void grab_set_free(GrabSet_t *self);
+
+#endif /* #ifndef GRAB_H */
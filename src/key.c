@@ -9,6 +9,7 @@
 #include <X11/Xlib.h>
 
 #include "key.h"
+#include "backend.h"
 #include "util.h"
 #include "xchainkeys.h"
 
@@ -33,7 +34,6 @@ Key_t* key_new(char *keyspec) {
 int key_parse_keyspec(Key_t *self, char *keyspec) {
 
   char str[256];
-  char *original_keyspec = strdup(keyspec);
   int len;
   int ret = True;
 
@@ -48,7 +48,6 @@ int key_parse_keyspec(Key_t *self, char *keyspec) {
     str[len] = '\0';
     
     if(!key_add_modifier(self, str)) {
-      free(original_keyspec);
       return False;
     }
     keyspec += len + 1;
@@ -56,7 +55,8 @@ int key_parse_keyspec(Key_t *self, char *keyspec) {
   
   /* keyspec now contains the valid keysym string or a numeric keycode */
 
-  /* parse as keysym string */
+  /* parse as keysym string. Its keycode is looked up by key_resolve()
+   * later, as this may run on the reload thread */
   self->keysym = XStringToKeysym(keyspec);
 
   if(self->keysym == NoSymbol) {
@@ -69,7 +69,6 @@ int key_parse_keyspec(Key_t *self, char *keyspec) {
     }
   }
   
-  free(original_keyspec);
   return ret;
 }
 
@@ -84,42 +83,55 @@ int key_add_modifier(Key_t *self, char *str) {
   return True;
 }
 
-int key_get_keycode(Key_t *self) {
+void key_resolve(Key_t *self) {
+
+  /* look up the keycode for the keysym of this key in the current
+   * keyboard mapping. Keys specified by a numeric keycode are left
+   * alone. */
+
   if(self->keysym != NoSymbol)
-    return XKeysymToKeycode(xc->display, self->keysym);
-  else
-    return self->keycode;
+    self->keycode = backend_keysym_to_keycode(xc->display, self->keysym);
 }
 
-int key_equals(Key_t *self, Key_t *key) {
-  if(self->modifiers == key->modifiers &&
-     key_get_keycode(self) == key_get_keycode(key))
-    return 1;
-  return 0;
+int key_get_keycode(Key_t *self) {
+  return self->keycode;
 }
 
-void key_grab(Key_t *self) {
-  int i;
+int key_equals(Key_t *self, Key_t *key) {
+  if(self->modifiers != key->modifiers)
+    return 0;
 
-  for( i=0; i<8; i++ ) {
-    XGrabKey(xc->display, key_get_keycode(self), self->modifiers | xc->modmask[i], 
-	     DefaultRootWindow(xc->display), False,
-	     GrabModeAsync, GrabModeAsync);
-  }
+  /* keys parsed but not resolved yet are told apart by their keysym */
+  if(self->keycode == 0 || key->keycode == 0)
+    return self->keysym == key->keysym;
+
+  return self->keycode == key->keycode;
 }
 
-void key_ungrab(Key_t *self) {
-  int i;
+void key_from_event(Key_t *self, XKeyEvent *event) {
 
-  for( i=0; i<8; i++ ) {
-    XUngrabKey(xc->display, key_get_keycode(self), self->modifiers | xc->modmask[i], 
-	       DefaultRootWindow(xc->display));
-  }
+  /* fill in a key from a key event without allocating anything. Just
+   * like for keys parsed from a keyspec, the keycode is the one that
+   * the keysym resolves to. */
+
+  self->keysym = backend_keycode_to_keysym(event->display, event->keycode);
+
+  if(self->keysym != NoSymbol)
+    self->keycode = backend_keysym_to_keycode(event->display, self->keysym);
+  else
+    self->keycode = event->keycode;
+
+  self->modifiers = get_event_modifiers(event);
 }
 
-char *key_to_str(Key_t *self) {
+void key_format(Key_t *self, char *str) {
+
+  /* write the keyspec for this key to str, which must be able to hold
+   * KEY_STR_SIZE characters */
+
+  char *name;
 
-  char *str = (char *) calloc(256, sizeof(char));
+  str[0] = '\0';
 
   if (self->modifiers & LockMask)    strcat(str, "lock-");
   if (self->modifiers & ControlMask) strcat(str, "C-");
@@ -130,10 +142,17 @@ char *key_to_str(Key_t *self) {
   if (self->modifiers & Mod5Mask)    strcat(str, "mod5-");
   if (self->modifiers & ShiftMask)   strcat(str, "S-");
 
-  if(self->keysym != NoSymbol)
-    strcat(str, XKeysymToString(self->keysym));
+  if(self->keysym != NoSymbol && (name = XKeysymToString(self->keysym)) != NULL)
+    strncat(str, name, KEY_STR_SIZE-strlen(str)-1);
   else
-    snprintf(str, 5, "0x%x", self->keycode);
+    snprintf(str+strlen(str), KEY_STR_SIZE-strlen(str), "0x%x", self->keycode);
+}
+
+char *key_to_str(Key_t *self) {
+
+  char *str = (char *) calloc(KEY_STR_SIZE, sizeof(char));
+
+  key_format(self, str);
 
   return str;	 
 }
@@ -1,6 +1,8 @@
 #ifndef KEY_H
 #define KEY_H
 
+#define KEY_STR_SIZE 256
+
 typedef struct Key {
   unsigned int modifiers;
   KeySym keysym;
@@ -10,10 +12,11 @@ typedef struct Key {
 Key_t* key_new(char *keyspec);
 int key_parse_keyspec(Key_t *key, char *keyspec);
 int key_add_modifier(Key_t *self, char *str);
+void key_resolve(Key_t *self);
 int key_get_keycode(Key_t *self);
 int key_equals(Key_t *self, Key_t *key);
-void key_grab(Key_t *self);
-void key_ungrab(Key_t *self);
+void key_from_event(Key_t *self, XKeyEvent *event);
+void key_format(Key_t *self, char *str);
 char *key_to_str(Key_t *self);
 
 #endif /* #ifndef KEY_H */
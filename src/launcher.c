@@ -0,0 +1,912 @@
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif /* _XOPEN_SOURCE */
+
+/* for wait4() */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif /* _DEFAULT_SOURCE */
+
+/* for POSIX_SPAWN_SETSID */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif /* _GNU_SOURCE */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <X11/Xlib.h>
+
+#include "arena.h"
+#include "key.h"
+#include "loop.h"
+#include "launcher.h"
+#include "log.h"
+#include "backend.h"
+#include "util.h"
+#include "xchainkeys.h"
+
+extern XChainKeys_t *xc;
+extern char **environ;
+
+/* executables looked up while parsing the current config, an empty
+ * string marks names not found in PATH. Only xc_read_config() uses
+ * these, and only one parse runs at a time, so they need no lock */
+static char *cache_names[LAUNCHER_CACHE_SIZE];
+static char *cache_executables[LAUNCHER_CACHE_SIZE];
+
+/* our end of the socket to the helper process, if started */
+static int helper = -1;
+
+/* commands still running, and where to report their exit from the
+ * SIGCHLD handler: a pipe read by the main loop in the daemon, the
+ * socket to the daemon in the helper */
+static LauncherChild_t *children = NULL;
+static int max_children = 0;
+static int exit_pipe[2] = { -1, -1 };
+static int report_fd = -1;
+static int report_socket = False;
+static volatile sig_atomic_t dump_requested = False;
+
+/* spawn statistics, one entry for each binding path that launched a
+ * command, kept across config reloads */
+static LauncherAccount_t *accounts = NULL;
+static int num_accounts = 0;
+static int max_accounts = 0;
+
+/* the command a :wait binding is waiting for, told apart from other
+ * commands by a serial number passed along with its request */
+static int watched = 0;
+static int watched_exited = False;
+static int watch_serial = 0;
+
+/* requests for the helper that didn't fit into its socket yet, sent
+ * as soon as it is writable again */
+static LauncherMessage_t *queue = NULL;
+static LauncherMessage_t *queue_tail = NULL;
+static int num_queued = 0;
+
+static void launcher_report(LauncherReport_t *report) {
+  if(report_fd == -1)
+    return;
+
+  /* a full pipe or socket loses the report, we can't block here */
+  if(report_socket) {
+    if(send(report_fd, report, sizeof(LauncherReport_t), MSG_DONTWAIT) == -1)
+      return;
+  }
+  else {
+    if(write(report_fd, report, sizeof(LauncherReport_t)) == -1)
+      return;
+  }
+}
+
+static void launcher_handle_sigchld(int sig) {
+  int saved_errno = errno;
+  LauncherReport_t report;
+  struct rusage usage;
+  int status;
+  pid_t pid;
+  int i;
+
+  /* commands are spawned as our own children, reap them as they exit
+   * and pass on their exit status and resource usage */
+  while((pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+    memset(&report, 0, sizeof(LauncherReport_t));
+    report.pid = pid;
+    report.token = -1;
+    report.status = status;
+    report.maxrss = usage.ru_maxrss;
+
+    for( i=0; i<max_children; i++ ) {
+      if(children[i].pid == pid) {
+	report.token = children[i].token;
+	report.watch = children[i].watch;
+	report.usec = get_usec() - children[i].start;
+	children[i].pid = 0;
+	break;
+      }
+    }
+    launcher_report(&report);
+  }
+  errno = saved_errno;
+}
+
+static void launcher_handle_sigusr1(int sig) {
+  int saved_errno = errno;
+  LauncherReport_t report;
+
+  /* wake up the main loop to dump the statistics */
+  memset(&report, 0, sizeof(LauncherReport_t));
+  report.token = -1;
+
+  dump_requested = True;
+  launcher_report(&report);
+
+  errno = saved_errno;
+}
+
+static void launcher_install_handlers(int fd, int is_socket) {
+  struct sigaction action;
+
+  report_fd = fd;
+  report_socket = is_socket;
+
+  memset(&action, 0, sizeof(struct sigaction));
+  action.sa_handler = launcher_handle_sigchld;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+
+  sigaction(SIGCHLD, &action, NULL);
+}
+
+void launcher_init(void) {
+  struct sigaction action;
+
+  if(exit_pipe[0] == -1 && pipe(exit_pipe) == 0) {
+    fcntl(exit_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(exit_pipe[1], F_SETFD, FD_CLOEXEC);
+    fcntl(exit_pipe[0], F_SETFL, fcntl(exit_pipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(exit_pipe[1], F_SETFL, fcntl(exit_pipe[1], F_GETFL) | O_NONBLOCK);
+  }
+  launcher_install_handlers(exit_pipe[1], False);
+
+  memset(&action, 0, sizeof(struct sigaction));
+  action.sa_handler = launcher_handle_sigusr1;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+
+  sigaction(SIGUSR1, &action, NULL);
+}
+
+static void launcher_input(int fd, void *data) {
+  launcher_process();
+}
+
+void launcher_add_to_loop(Loop_t *loop) {
+
+  /* process the reports of exited commands as they arrive */
+  loop_watch(loop, exit_pipe[0], launcher_input, NULL);
+  loop_watch(loop, helper, launcher_input, NULL);
+}
+
+int launcher_account(char *path) {
+  int i;
+
+  for( i=0; i<num_accounts; i++ ) {
+    if(strcmp(accounts[i].path, path) == 0)
+      return i;
+  }
+
+  if(num_accounts == max_accounts) {
+    max_accounts = (max_accounts == 0) ? 16 : max_accounts * 2;
+    accounts = (LauncherAccount_t *) 
+      realloc(accounts, max_accounts * sizeof(LauncherAccount_t));
+  }
+
+  memset(&accounts[num_accounts], 0, sizeof(LauncherAccount_t));
+  accounts[num_accounts].path = strdup(path);
+  return num_accounts++;
+}
+
+void launcher_account_exit(LauncherReport_t *report) {
+  LauncherAccount_t *account;
+  LauncherRequest_t request;
+  char **argv;
+  char *command;
+  char *executable;
+
+  if(watched != 0 && report->watch == watched)
+    watched_exited = True;
+
+  if(report->token < 0 || report->token >= num_accounts)
+    return;
+
+  account = &accounts[report->token];
+  account->running--;
+
+  /* the helper failed to spawn the command */
+  if(report->pid == -1) {
+    account->spawns--;
+    account->failures++;
+    return;
+  }
+
+  account->exits++;
+  account->status = report->status;
+  account->total_usec += report->usec;
+
+  if(report->usec > account->max_usec)
+    account->max_usec = report->usec;
+
+  if(report->maxrss > account->maxrss)
+    account->maxrss = report->maxrss;
+
+  /* launch the command merged while this one was running */
+  if(account->running == 0 && account->pending_size > 0) {
+    argv = launcher_decode(account->pending, account->pending_size, &request,
+			   &executable, &command);
+    account->pending_size = 0;
+
+    if(argv != NULL) {
+      launcher_launch(executable, argv, command, report->token);
+      free(argv);
+    }
+  }
+}
+
+static void launcher_close_helper(void) {
+  LauncherMessage_t *queued;
+  LauncherRequest_t request;
+  LauncherReport_t report;
+
+  if(xc->loop != NULL)
+    loop_unwatch(xc->loop, helper);
+  close(helper);
+  helper = -1;
+
+  /* the requests still queued for the helper have failed */
+  while((queued = queue) != NULL) {
+    queue = queued->next;
+    num_queued--;
+
+    memcpy(&request, queued->data, sizeof(LauncherRequest_t));
+    free(queued->data);
+    free(queued);
+
+    memset(&report, 0, sizeof(LauncherReport_t));
+    report.pid = -1;
+    report.token = request.token;
+    report.watch = request.watch;
+    launcher_account_exit(&report);
+  }
+  queue_tail = NULL;
+}
+
+void launcher_process(void) {
+  LauncherReport_t report;
+  ssize_t size;
+
+  while(read(exit_pipe[0], &report, sizeof(LauncherReport_t)) == 
+	sizeof(LauncherReport_t)) {
+    launcher_account_exit(&report);
+  }
+
+  while(helper != -1) {
+    size = recv(helper, &report, sizeof(LauncherReport_t), MSG_DONTWAIT);
+
+    if(size == sizeof(LauncherReport_t)) {
+      launcher_account_exit(&report);
+      continue;
+    }
+
+    if(size == 0) {
+      fprintf(stderr, "%s: error: the launcher has exited\n", PACKAGE_NAME);
+      fflush(stderr);
+      launcher_close_helper();
+    }
+    break;
+  }
+
+  if(dump_requested) {
+    dump_requested = False;
+    log_flush(xc->log);
+    xc_dump(xc, stdout);
+  }
+}
+
+void launcher_dump(FILE *file) {
+  LauncherAccount_t *account;
+  int status;
+  int i;
+
+  /* tab separated, one line per binding path, the exit status is
+   * negative for commands killed by a signal */
+  fprintf(file, "# path\tspawns\trunning\tfailures\tcoalesced\texits\t"
+	  "status\twall_ms\tmax_wall_ms\tmax_rss_kb\n");
+
+  for( i=0; i<num_accounts; i++ ) {
+    account = &accounts[i];
+
+    if(WIFSIGNALED(account->status))
+      status = -WTERMSIG(account->status);
+    else
+      status = WEXITSTATUS(account->status);
+
+    fprintf(file, "%s\t%lu\t%d\t%lu\t%lu\t%lu\t%d\t%.3f\t%.3f\t%ld\n",
+	    account->path, account->spawns, account->running, 
+	    account->failures, account->coalesced, account->exits, status,
+	    account->total_usec / 1000.0, account->max_usec / 1000.0,
+	    account->maxrss);
+  }
+  fflush(file);
+}
+
+static void launcher_track(pid_t pid, int token, int watch, long start) {
+  int i;
+
+  /* called with SIGCHLD blocked, and the other threads block it too,
+   * so the handler can't be looking at the table while it grows. Every
+   * command has to be tracked, or its exit would never be accounted
+   * for and its path never be launched again with coalescing on */
+  for( i=0; i<max_children; i++ ) {
+    if(children[i].pid == 0)
+      break;
+  }
+
+  if(i == max_children) {
+    max_children = (max_children == 0) ? 
+      LAUNCHER_CHILDREN_SIZE : max_children * 2;
+    children = (LauncherChild_t *) 
+      realloc(children, max_children * sizeof(LauncherChild_t));
+    memset(&children[i], 0, (max_children - i) * sizeof(LauncherChild_t));
+  }
+
+  children[i].pid = pid;
+  children[i].token = token;
+  children[i].watch = watch;
+  children[i].start = start;
+}
+
+static pid_t launcher_start(char *executable, char **argv, char *command, 
+			    int token, int watch) {
+  sigset_t mask, old;
+  long start = get_usec();
+  pid_t pid;
+
+  /* SIGCHLD is blocked until the pid is recorded, in case the command
+   * exits right away */
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &mask, &old);
+
+  if((pid = launcher_spawn(executable, argv, command)) > 0)
+    launcher_track(pid, token, watch, start);
+
+  sigprocmask(SIG_SETMASK, &old, NULL);
+  return pid;
+}
+
+void launcher_flush_cache(void) {
+  int i;
+
+  for( i=0; i<LAUNCHER_CACHE_SIZE; i++ ) {
+    free(cache_names[i]);
+    free(cache_executables[i]);
+    cache_names[i] = cache_executables[i] = NULL;
+  }
+}
+
+char *launcher_find_executable(char *name, Arena_t *arena) {
+  struct stat st;
+  char file[4096];
+  char *path;
+  char *dir;
+  char *found = NULL;
+  unsigned int hash = 5381;
+  unsigned int slot;
+  size_t len;
+  int i;
+
+  if(strchr(name, '/') != NULL) {
+    if(access(name, X_OK) == 0 && stat(name, &st) == 0 && S_ISREG(st.st_mode))
+      return arena_strdup(arena, name);
+    return NULL;
+  }
+
+  /* most configs run the same few programs over and over, look each
+   * of them up only once per config */
+  for( i=0; name[i] != '\0'; i++ ) {
+    hash = hash * 33 + (unsigned char) name[i];
+  }
+  slot = hash % LAUNCHER_CACHE_SIZE;
+
+  for( i=0; i<LAUNCHER_CACHE_SIZE; i++ ) {
+    if(cache_names[slot] == NULL)
+      break;
+
+    if(strcmp(cache_names[slot], name) == 0) {
+      if(cache_executables[slot][0] == '\0')
+	return NULL;
+      return arena_strdup(arena, cache_executables[slot]);
+    }
+    slot = (slot + 1) % LAUNCHER_CACHE_SIZE;
+  }
+
+  if((path = getenv("PATH")) == NULL)
+    path = "/usr/local/bin:/bin:/usr/bin";
+
+  /* try each directory in PATH, an empty entry means the current
+   * directory */
+  dir = path;
+  while(True) {
+    len = strcspn(dir, ":");
+
+    if(len == 0)
+      snprintf(file, sizeof(file), "./%s", name);
+    else
+      snprintf(file, sizeof(file), "%.*s/%s", (int) len, dir, name);
+
+    if(access(file, X_OK) == 0 && stat(file, &st) == 0 && S_ISREG(st.st_mode)) {
+      found = file;
+      break;
+    }
+
+    if(dir[len] == '\0')
+      break;
+    dir += len + 1;
+  }
+
+  /* remember the result unless the cache is full */
+  if(cache_names[slot] == NULL) {
+    cache_names[slot] = strdup(name);
+    cache_executables[slot] = strdup((found != NULL) ? found : "");
+  }
+
+  if(found == NULL)
+    return NULL;
+  return arena_strdup(arena, found);
+}
+
+char **launcher_parse_command(char *command, char **executable, 
+			      Arena_t *arena) {
+  char *ws = " \t";
+  char **argv;
+  char *word;
+  int argc = 0;
+  int i;
+
+  /* commands using quotes, expansions, redirections or other shell
+   * syntax are left to the shell */
+  *executable = NULL;
+
+  if(command[strcspn(command, LAUNCHER_SHELL_CHARS)] != '\0')
+    return NULL;
+
+  word = command + strspn(command, ws);
+  if(*word == '\0')
+    return NULL;
+
+  /* a leading assignment sets the environment for the command */
+  if(memchr(word, '=', strcspn(word, ws)) != NULL)
+    return NULL;
+
+  while(*word != '\0') {
+    argc++;
+    word += strcspn(word, ws);
+    word += strspn(word, ws);
+  }
+
+  argv = (char **) arena_alloc(arena, (argc + 1) * sizeof(char *));
+  word = command + strspn(command, ws);
+
+  for(i=0; i<argc; i++) {
+    argv[i] = arena_strndup(arena, word, strcspn(word, ws));
+    word += strcspn(word, ws);
+    word += strspn(word, ws);
+  }
+  argv[argc] = NULL;
+
+  /* builtins like cd or exec are not found in PATH and need the shell
+   * as well */
+  if((*executable = launcher_find_executable(argv[0], arena)) == NULL)
+    return NULL;
+
+  return argv;
+}
+
+pid_t launcher_spawn(char *executable, char **argv, char *command) {
+  posix_spawnattr_t attr;
+  sigset_t mask;
+  pid_t pid;
+  short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+  int error = -1;
+  char *shell_argv[4];
+
+  shell_argv[0] = "sh";
+  shell_argv[1] = "-c";
+  shell_argv[2] = command;
+  shell_argv[3] = NULL;
+
+  /* start the command in a session of its own with a clean signal
+   * state, as the setsid() of the former double fork did. It stays our
+   * child though, so its exit can be accounted for. C libraries
+   * without POSIX_SPAWN_SETSID (glibc < 2.26) only give it a process
+   * group of its own, and it keeps our controlling terminal */
+  posix_spawnattr_init(&attr);
+#ifdef POSIX_SPAWN_SETSID
+  flags |= POSIX_SPAWN_SETSID;
+#else
+  flags |= POSIX_SPAWN_SETPGROUP;
+  posix_spawnattr_setpgroup(&attr, 0);
+#endif
+  posix_spawnattr_setflags(&attr, flags);
+
+  sigemptyset(&mask);
+  posix_spawnattr_setsigmask(&attr, &mask);
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGUSR1);
+  sigaddset(&mask, SIGPIPE);
+  posix_spawnattr_setsigdefault(&attr, &mask);
+
+  /* run simple commands directly, and through the shell if they need
+   * it or their executable went away since the config was parsed */
+  if(executable != NULL)
+    error = posix_spawn(&pid, executable, NULL, &attr, argv, environ);
+
+  if(error != 0) {
+    executable = NULL;
+    error = posix_spawn(&pid, "/bin/sh", NULL, &attr, shell_argv, environ);
+  }
+  posix_spawnattr_destroy(&attr);
+
+  if (error != 0) {
+    fprintf(stderr, "%s: error: failed to spawn '%s': %s\n", 
+	    PACKAGE_NAME, command, strerror(error));
+    fflush(stderr);
+    return -1;
+  }
+
+  backend_mark(BACKEND_MARK_EXEC);
+
+  log_printf(xc->log, LOG_LEVEL_DEBUG, 
+	     "Spawned pid %d %s in %ld usec after the key event\n", 
+	     (int) pid, (executable != NULL) ? "directly" : "through the shell",
+	     get_usec() - xc->event_usec);
+  return pid;
+}
+
+void launcher_start_helper(void) {
+  int fds[2];
+  pid_t pid;
+
+  /* the helper is forked while we are still small and not connected
+   * to the X server, it spawns commands on our behalf from then on */
+  if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == -1) {
+    fprintf(stderr, "%s: error: failed to create launcher socket: %s\n", 
+	    PACKAGE_NAME, strerror(errno));
+    fflush(stderr);
+    return;
+  }
+
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+  switch(pid = fork()) {
+  case -1:
+    fprintf(stderr, "%s: error: failed to fork launcher: %s\n", 
+	    PACKAGE_NAME, strerror(errno));
+    fflush(stderr);
+    close(fds[0]);
+    close(fds[1]);
+    return;
+
+  case 0:
+    close(fds[0]);
+    launcher_run_helper(fds[1]);
+    _exit(EXIT_SUCCESS);
+
+  default:
+    close(fds[1]);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    helper = fds[0];
+
+    log_printf(xc->log, LOG_LEVEL_INFO, "Started launcher with pid %d\n", 
+	       (int) pid);
+    break;
+  }
+}
+
+size_t launcher_encode(char *message, char *executable, char **argv, 
+		       char *command, int token, int watch) {
+  LauncherRequest_t request;
+  size_t size = 0;
+  size_t len;
+  int i;
+
+  /* a request holds its header, the command, its executable (empty
+   * for the shell) and its argv, each string terminated by a NUL
+   * byte.  Returns 0 if it doesn't fit into LAUNCHER_MESSAGE_SIZE */
+  memset(&request, 0, sizeof(LauncherRequest_t));
+  request.event_usec = xc->event_usec;
+  request.token = token;
+  request.watch = watch;
+
+  memcpy(message, &request, sizeof(LauncherRequest_t));
+  size += sizeof(LauncherRequest_t);
+
+  len = strlen(command) + 1;
+  if(size + len > LAUNCHER_MESSAGE_SIZE)
+    return 0;
+  memcpy(message + size, command, len);
+  size += len;
+
+  if(executable == NULL) 
+    executable = "";
+
+  len = strlen(executable) + 1;
+  if(size + len > LAUNCHER_MESSAGE_SIZE)
+    return 0;
+  memcpy(message + size, executable, len);
+  size += len;
+
+  for( i=0; executable[0] != '\0' && argv[i] != NULL; i++ ) {
+    len = strlen(argv[i]) + 1;
+    if(size + len > LAUNCHER_MESSAGE_SIZE)
+      return 0;
+    memcpy(message + size, argv[i], len);
+    size += len;
+  }
+  return size;
+}
+
+char **launcher_decode(char *message, size_t size, LauncherRequest_t *request,
+		       char **executable, char **command) {
+  char **argv;
+  char *str;
+  int argc = 0;
+  int i;
+
+  /* returns the argv of a request, to be freed by the caller, and
+   * points the strings into the message */
+  if(size < sizeof(LauncherRequest_t) + 2 || message[size-1] != '\0')
+    return NULL;
+
+  memcpy(request, message, sizeof(LauncherRequest_t));
+
+  *command = message + sizeof(LauncherRequest_t);
+  *executable = *command + strlen(*command) + 1;
+
+  for( str = *executable + strlen(*executable) + 1; 
+       str < message + size; str += strlen(str) + 1 ) {
+    argc++;
+  }
+
+  argv = (char **) calloc(argc + 1, sizeof(char *));
+  str = *executable + strlen(*executable) + 1;
+
+  for( i=0; i<argc; i++ ) {
+    argv[i] = str;
+    str += strlen(str) + 1;
+  }
+
+  if(argc == 0 || **executable == '\0')
+    *executable = NULL;
+
+  return argv;
+}
+
+void launcher_run_helper(int fd) {
+  char message[LAUNCHER_MESSAGE_SIZE];
+  LauncherRequest_t request;
+  LauncherReport_t report;
+  char **argv;
+  char *command;
+  char *executable;
+  ssize_t size;
+
+  /* report exits to the daemon, and leave SIGUSR1 to it */
+  launcher_install_handlers(fd, True);
+  signal(SIGUSR1, SIG_IGN);
+
+  while(True) {
+    size = recv(fd, message, sizeof(message), 0);
+
+    if(size < 0 && errno == EINTR)
+      continue;
+
+    /* the daemon has exited */
+    if(size <= 0)
+      break;
+
+    argv = launcher_decode(message, size, &request, &executable, &command);
+    if(argv == NULL)
+      continue;
+
+    xc->event_usec = request.event_usec;
+
+    if(launcher_start(executable, argv, command, request.token, 
+		      request.watch) == -1) {
+      memset(&report, 0, sizeof(LauncherReport_t));
+      report.pid = -1;
+      report.token = request.token;
+      report.watch = request.watch;
+      launcher_report(&report);
+    }
+    free(argv);
+  }
+  close(fd);
+}
+
+static int launcher_write(char *message, size_t size) {
+  int flags = MSG_DONTWAIT;
+
+#ifdef MSG_NOSIGNAL
+  flags |= MSG_NOSIGNAL;
+#endif
+
+  if(send(helper, message, size, flags) == (ssize_t) size)
+    return True;
+
+  /* the helper is busy, or gone */
+  if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+    fprintf(stderr, "%s: error: lost the launcher: %s\n", 
+	    PACKAGE_NAME, strerror(errno));
+    fflush(stderr);
+    launcher_close_helper();
+  }
+  return False;
+}
+
+static void launcher_output(int fd, void *data) {
+  LauncherMessage_t *queued;
+
+  /* the socket to the helper has room again, send what is queued in
+   * the order it was requested */
+  while(queue != NULL && launcher_write(queue->data, queue->size)) {
+    queued = queue;
+    queue = queued->next;
+    num_queued--;
+
+    free(queued->data);
+    free(queued);
+  }
+
+  if(queue == NULL) {
+    queue_tail = NULL;
+
+    if(helper != -1 && xc->loop != NULL)
+      loop_on_writable(xc->loop, helper, NULL);
+  }
+}
+
+int launcher_send(char *message, size_t size) {
+  LauncherMessage_t *queued;
+
+  if(helper == -1)
+    return False;
+
+  /* send what the helper has made room for since, nothing may
+   * overtake the requests already queued */
+  if(queue != NULL)
+    launcher_output(helper, NULL);
+
+  if(queue == NULL && helper != -1 && launcher_write(message, size))
+    return True;
+
+  if(helper == -1)
+    return False;
+
+  /* the helper is busy spawning, have it catch up instead of spawning
+   * from here */
+  if(num_queued == LAUNCHER_MAX_QUEUED) {
+    fprintf(stderr, "%s: error: the launcher is not keeping up\n", 
+	    PACKAGE_NAME);
+    fflush(stderr);
+    return False;
+  }
+
+  queued = (LauncherMessage_t *) calloc(1, sizeof(LauncherMessage_t));
+  queued->data = (char *) malloc(size);
+  queued->size = size;
+  memcpy(queued->data, message, size);
+
+  if(queue_tail != NULL)
+    queue_tail->next = queued;
+  else
+    queue = queued;
+  queue_tail = queued;
+  num_queued++;
+
+  if(xc->loop != NULL)
+    loop_on_writable(xc->loop, helper, launcher_output);
+  return True;
+}
+
+static int launcher_request(char *executable, char **argv, char *command,
+			    int token, int watch) {
+  char message[LAUNCHER_MESSAGE_SIZE];
+  size_t size;
+
+  /* once the helper runs, it spawns every command, so that we never
+   * fork after startup. We only spawn them ourselves without it */
+  if(helper != -1) {
+    size = launcher_encode(message, executable, argv, command, token, watch);
+
+    if(size == 0) {
+      fprintf(stderr, "%s: error: '%s': too long for the launcher\n", 
+	      PACKAGE_NAME, command);
+      fflush(stderr);
+      return False;
+    }
+
+    if(launcher_send(message, size))
+      return True;
+
+    if(helper != -1)
+      return False;
+  }
+  return launcher_start(executable, argv, command, token, watch) > 0;
+}
+
+void launcher_launch(char *executable, char **argv, char *command, 
+		     int token) {
+  if(launcher_request(executable, argv, command, token, 0)) {
+    accounts[token].spawns++;
+    accounts[token].running++;
+  }
+  else {
+    accounts[token].failures++;
+  }
+}
+
+int launcher_watch(char *executable, char **argv, char *command, 
+		   char *path) {
+  int token = launcher_account(path);
+
+  /* launch the command like any other, the exit report carrying its
+   * serial number tells launcher_watch_done() that it has exited */
+  watched = ++watch_serial;
+  watched_exited = False;
+
+  if(!launcher_request(executable, argv, command, token, watched)) {
+    accounts[token].failures++;
+    watched = 0;
+    return False;
+  }
+
+  accounts[token].spawns++;
+  accounts[token].running++;
+  return True;
+}
+
+int launcher_watch_done(void) {
+  launcher_process();
+  return watched_exited;
+}
+
+void launcher_unwatch(void) {
+  watched = 0;
+  watched_exited = False;
+}
+
+void launcher_exec(char *executable, char **argv, char *command, char *path,
+		   int coalesce) {
+  LauncherAccount_t *account;
+  char message[LAUNCHER_MESSAGE_SIZE];
+  size_t size;
+  int token = launcher_account(path);
+
+  account = &accounts[token];
+
+  /* while the previous command is still running, merge any further
+   * launches into a single one after it exits */
+  if(coalesce && account->running > 0 &&
+     (size = launcher_encode(message, executable, argv, command, token, 
+			     0)) > 0) {
+
+    if(account->pending == NULL)
+      account->pending = (char *) malloc(LAUNCHER_MESSAGE_SIZE);
+
+    memcpy(account->pending, message, size);
+    account->pending_size = size;
+    account->coalesced++;
+
+    log_printf(xc->log, LOG_LEVEL_DEBUG, "Coalesced launch of %s\n", path);
+    return;
+  }
+  launcher_launch(executable, argv, command, token);
+}
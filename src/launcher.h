@@ -0,0 +1,80 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#define LAUNCHER_CACHE_SIZE 256
+#define LAUNCHER_CHILDREN_SIZE 256
+#define LAUNCHER_MESSAGE_SIZE 8192
+#define LAUNCHER_MAX_QUEUED 256
+#define LAUNCHER_SHELL_CHARS "|&;<>()$`\\\"'*?[]#~{}!\n"
+
+typedef struct LauncherChild {
+  pid_t pid;
+  int token;
+  int watch;
+  long start;
+} LauncherChild_t;
+
+typedef struct LauncherRequest {
+  long event_usec;
+  int token;
+  int watch;
+} LauncherRequest_t;
+
+typedef struct LauncherReport {
+  pid_t pid;
+  int token;
+  int watch;
+  int status;
+  long usec;
+  long maxrss;
+} LauncherReport_t;
+
+typedef struct LauncherAccount {
+  char *path;
+  unsigned long spawns;
+  unsigned long failures;
+  unsigned long exits;
+  unsigned long coalesced;
+  char *pending;
+  size_t pending_size;
+  int running;
+  int status;
+  long total_usec;
+  long max_usec;
+  long maxrss;
+} LauncherAccount_t;
+
+typedef struct LauncherMessage {
+  char *data;
+  size_t size;
+  struct LauncherMessage *next;
+} LauncherMessage_t;
+
+void launcher_init(void);
+void launcher_add_to_loop(Loop_t *loop);
+int launcher_account(char *path);
+void launcher_account_exit(LauncherReport_t *report);
+void launcher_process(void);
+void launcher_dump(FILE *file);
+void launcher_flush_cache(void);
+int launcher_watch(char *executable, char **argv, char *command, 
+		   char *path);
+int launcher_watch_done(void);
+void launcher_unwatch(void);
+char *launcher_find_executable(char *name, Arena_t *arena);
+char **launcher_parse_command(char *command, char **executable, 
+			      Arena_t *arena);
+pid_t launcher_spawn(char *executable, char **argv, char *command);
+void launcher_start_helper(void);
+void launcher_run_helper(int fd);
+size_t launcher_encode(char *message, char *executable, char **argv, 
+		       char *command, int token, int watch);
+char **launcher_decode(char *message, size_t size, LauncherRequest_t *request,
+		       char **executable, char **command);
+int launcher_send(char *message, size_t size);
+void launcher_launch(char *executable, char **argv, char *command, 
+		     int token);
+void launcher_exec(char *executable, char **argv, char *command, char *path,
+		   int coalesce);
+
+#endif /* #ifndef LAUNCHER_H */
@@ -0,0 +1,162 @@
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 500
+#endif /* _XOPEN_SOURCE */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <X11/Xlib.h>
+
+#include "key.h"
+#include "log.h"
+#include "util.h"
+
+/* Log messages are formatted into a ring buffer on the spot and only
+ * written out by log_flush(), which the main loop calls before going
+ * to sleep, so a slow stdout never delays handling a key. Everything
+ * runs on the main thread, so the ring needs no locking. If the ring
+ * fills up before it is flushed, new records are dropped and counted
+ * instead of blocking. */
+
+static char *level_names[] = { "quiet", "info", "debug" };
+
+Log_t *log_new(void) {
+  Log_t *self = (Log_t *) calloc(1, sizeof(Log_t));
+
+  self->level = LOG_LEVEL_QUIET;
+  self->binary = False;
+  self->file = stdout;
+  self->buffer = (char *) calloc(LOG_SIZE, sizeof(char));
+  self->head = 0;
+  self->tail = 0;
+  self->dropped = 0;
+
+  return self;
+}
+
+int log_parse_level(char *name) {
+  int i;
+
+  for (i = LOG_LEVEL_QUIET; i <= LOG_LEVEL_DEBUG; i++) {
+    if (strcmp(name, level_names[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+int log_open_trace(Log_t *self, char *path) {
+  FILE *file;
+
+  if ((file = fopen(path, "w")) == NULL) {
+    fprintf(stderr, "%s: error: failed to open trace file '%s': %s\n",
+	    PACKAGE_NAME, path, strerror(errno));
+    fflush(stderr);
+    return False;
+  }
+  fcntl(fileno(file), F_SETFD, FD_CLOEXEC);
+
+  self->file = file;
+  self->binary = True;
+  return True;
+}
+
+static void log_copy_in(Log_t *self, void *data, size_t size) {
+  size_t offset = self->head % LOG_SIZE;
+  size_t first = (size < LOG_SIZE - offset) ? size : LOG_SIZE - offset;
+
+  memcpy(self->buffer + offset, data, first);
+  memcpy(self->buffer, (char *) data + first, size - first);
+  self->head += size;
+}
+
+static void log_copy_out(Log_t *self, void *data, size_t size) {
+  size_t offset = self->tail % LOG_SIZE;
+  size_t first = (size < LOG_SIZE - offset) ? size : LOG_SIZE - offset;
+
+  memcpy(data, self->buffer + offset, first);
+  memcpy((char *) data + first, self->buffer, size - first);
+  self->tail += size;
+}
+
+void log_printf(Log_t *self, int level, char *format, ...) {
+  char message[LOG_MAX_MESSAGE];
+  LogRecord_t record;
+  va_list args;
+  int length;
+
+  if (level > self->level)
+    return;
+
+  va_start(args, format);
+  length = vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+
+  if (length < 0)
+    return;
+
+  if (length >= sizeof(message))
+    length = sizeof(message) - 1;
+
+  if (LOG_SIZE - (self->head - self->tail) < sizeof(record) + length) {
+    self->dropped++;
+    return;
+  }
+
+  record.usec = get_usec();
+  record.level = level;
+  record.length = length;
+
+  log_copy_in(self, &record, sizeof(record));
+  log_copy_in(self, message, length);
+}
+
+static void log_drain(Log_t *self) {
+  char message[LOG_MAX_MESSAGE];
+  LogRecord_t record;
+
+  while (self->tail != self->head) {
+    log_copy_out(self, &record, sizeof(record));
+    log_copy_out(self, message, record.length);
+
+    if (self->binary)
+      fwrite(&record, sizeof(record), 1, self->file);
+    fwrite(message, 1, record.length, self->file);
+  }
+}
+
+void log_flush(Log_t *self) {
+  unsigned long dropped;
+
+  if (self->head == self->tail)
+    return;
+
+  log_drain(self);
+
+  if (self->dropped > 0) {
+    dropped = self->dropped;
+    self->dropped = 0;
+    log_printf(self, LOG_LEVEL_QUIET, "%lu log messages dropped\n", dropped);
+    log_drain(self);
+  }
+  fflush(self->file);
+}
+
+void log_idle(void *data) {
+  log_flush((Log_t *) data);
+}
+
+void log_free(Log_t *self) {
+  if (self == NULL)
+    return;
+
+  log_flush(self);
+
+  if (self->file != stdout)
+    fclose(self->file);
+
+  free(self->buffer);
+  free(self);
+}
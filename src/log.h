@@ -0,0 +1,37 @@
+#ifndef LOG_H
+#define LOG_H
+
+#define LOG_LEVEL_QUIET 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_DEBUG 2
+
+#define LOG_SIZE 65536
+#define LOG_MAX_MESSAGE 1024
+
+/* a record in the ring buffer is this header followed by the text of
+ * the message, which is also how records are written in binary mode */
+typedef struct LogRecord {
+  long usec;
+  int level;
+  int length;
+} LogRecord_t;
+
+typedef struct Log {
+  int level;
+  int binary;
+  FILE *file;
+  char *buffer;
+  unsigned long head;
+  unsigned long tail;
+  unsigned long dropped;
+} Log_t;
+
+Log_t *log_new(void);
+int log_parse_level(char *name);
+int log_open_trace(Log_t *self, char *path);
+void log_printf(Log_t *self, int level, char *format, ...);
+void log_flush(Log_t *self);
+void log_idle(void *data);
+void log_free(Log_t *self);
+
+#endif /* #ifndef LOG_H */
@@ -0,0 +1,276 @@
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 500
+#endif /* _XOPEN_SOURCE */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+#include <X11/Xlib.h>
+
+#include "key.h"
+#include "loop.h"
+#include "backend.h"
+#include "util.h"
+
+Loop_t *loop_new(void) {
+  Loop_t *self = (Loop_t *) calloc(1, sizeof(Loop_t));
+
+  self->num_watches = 0;
+  self->timers = NULL;
+  self->idle = NULL;
+  self->idle_data = NULL;
+  self->epoll = -1;
+
+#ifdef HAVE_SYS_EPOLL_H
+  if((self->epoll = epoll_create(LOOP_MAX_WATCHES)) == -1) {
+    fprintf(stderr, "%s: error: epoll_create() failed\n", PACKAGE_NAME);
+    fflush(stderr);
+    exit(EXIT_FAILURE);
+  }
+#endif
+  return self;
+}
+
+void loop_watch(Loop_t *self, int fd, 
+		void (*callback)(int fd, void *data), void *data) {
+  LoopWatch_t *watch;
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event event;
+#endif
+
+  /* descriptors without a callback just wake up loop_wait(), e.g. the
+   * X connection, whose events are read by the caller */
+  if(fd == -1 || self->num_watches == LOOP_MAX_WATCHES)
+    return;
+
+  watch = &self->watches[self->num_watches++];
+  watch->fd = fd;
+  watch->callback = callback;
+  watch->writable = NULL;
+  watch->data = data;
+
+#ifdef HAVE_SYS_EPOLL_H
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  epoll_ctl(self->epoll, EPOLL_CTL_ADD, fd, &event);
+#endif
+}
+
+void loop_unwatch(Loop_t *self, int fd) {
+  int i;
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event event;
+#endif
+
+  for( i=0; i<self->num_watches; i++ ) {
+    if(self->watches[i].fd == fd) {
+      self->watches[i] = self->watches[--self->num_watches];
+
+#ifdef HAVE_SYS_EPOLL_H
+      epoll_ctl(self->epoll, EPOLL_CTL_DEL, fd, &event);
+#endif
+      return;
+    }
+  }
+}
+
+void loop_on_writable(Loop_t *self, int fd, 
+		      void (*writable)(int fd, void *data)) {
+  LoopWatch_t *watch = NULL;
+  int i;
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event event;
+#endif
+
+  /* also call writable whenever the watched descriptor can be written
+   * to, or stop doing so if it is NULL. Only ask for this while there
+   * is something to write, as it holds true most of the time */
+  for( i=0; i<self->num_watches; i++ ) {
+    if(self->watches[i].fd == fd)
+      watch = &self->watches[i];
+  }
+
+  if(watch == NULL || watch->writable == writable)
+    return;
+
+  watch->writable = writable;
+
+#ifdef HAVE_SYS_EPOLL_H
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events = (writable != NULL) ? EPOLLIN | EPOLLOUT : EPOLLIN;
+  event.data.fd = fd;
+  epoll_ctl(self->epoll, EPOLL_CTL_MOD, fd, &event);
+#endif
+}
+
+void loop_on_idle(Loop_t *self, void (*callback)(void *data), void *data) {
+
+  /* called before going to sleep, for work that can wait until no
+   * key is being handled */
+  self->idle = callback;
+  self->idle_data = data;
+}
+
+void loop_timer_init(LoopTimer_t *timer, 
+		     void (*callback)(LoopTimer_t *timer, void *data), 
+		     void *data) {
+  timer->deadline = 0;
+  timer->armed = False;
+  timer->fired = False;
+  timer->callback = callback;
+  timer->data = data;
+  timer->next = NULL;
+}
+
+void loop_arm(Loop_t *self, LoopTimer_t *timer, long usec) {
+  loop_arm_at(self, timer, get_usec() + usec);
+}
+
+void loop_arm_at(Loop_t *self, LoopTimer_t *timer, long deadline) {
+  LoopTimer_t **next;
+
+  /* timers keep their absolute deadline on the monotonic clock, so
+   * unrelated wakeups don't stretch them.  The list is kept sorted by
+   * deadline */
+  loop_disarm(self, timer);
+
+  timer->deadline = deadline;
+  timer->armed = True;
+  timer->fired = False;
+
+  next = &self->timers;
+  while(*next != NULL && (*next)->deadline <= deadline)
+    next = &(*next)->next;
+
+  timer->next = *next;
+  *next = timer;
+}
+
+void loop_disarm(Loop_t *self, LoopTimer_t *timer) {
+  LoopTimer_t **next;
+
+  timer->fired = False;
+
+  if(!timer->armed)
+    return;
+
+  for( next = &self->timers; *next != NULL; next = &(*next)->next ) {
+    if(*next == timer) {
+      *next = timer->next;
+      break;
+    }
+  }
+  timer->armed = False;
+  timer->next = NULL;
+}
+
+void loop_expire(Loop_t *self) {
+  LoopTimer_t *timer;
+  long now = get_usec();
+
+  while(self->timers != NULL && self->timers->deadline <= now) {
+    timer = self->timers;
+    self->timers = timer->next;
+
+    timer->next = NULL;
+    timer->armed = False;
+    timer->fired = True;
+
+    if(timer->callback != NULL)
+      timer->callback(timer, timer->data);
+  }
+}
+
+void loop_wait(Loop_t *self) {
+  LoopWatch_t *watch;
+  long now;
+  long usec = -1;
+  int timeout;
+  int ready;
+  int output;
+  int input;
+  int fd;
+  int i, j;
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event events[LOOP_MAX_WATCHES];
+#else
+  struct pollfd fds[LOOP_MAX_WATCHES];
+#endif
+
+  /* sleep until a watched descriptor is readable or the next timer
+   * is due, then run the callbacks of both.  Callers check their own
+   * state afterwards, since signals may wake us up early as well */
+  if(self->timers != NULL) {
+    now = get_usec();
+    usec = (self->timers->deadline > now) ? self->timers->deadline - now : 0;
+  }
+
+  if(usec != 0 && self->idle != NULL)
+    self->idle(self->idle_data);
+
+  /* the fake backend advances its clock to the deadline instead */
+  timeout = backend_idle(usec);
+
+#ifdef HAVE_SYS_EPOLL_H
+  ready = epoll_wait(self->epoll, events, LOOP_MAX_WATCHES, timeout);
+
+  for( i=0; i<ready; i++ ) {
+    fd = events[i].data.fd;
+    output = (events[i].events & EPOLLOUT) != 0;
+    input = (events[i].events & ~EPOLLOUT) != 0;
+#else
+  for( i=0; i<self->num_watches; i++ ) {
+    fds[i].fd = self->watches[i].fd;
+    fds[i].events = POLLIN;
+    if(self->watches[i].writable != NULL)
+      fds[i].events |= POLLOUT;
+    fds[i].revents = 0;
+  }
+  ready = poll(fds, self->num_watches, timeout);
+
+  for( i=0; ready > 0 && i<self->num_watches; i++ ) {
+    if(fds[i].revents == 0)
+      continue;
+    fd = fds[i].fd;
+    output = (fds[i].revents & POLLOUT) != 0;
+    input = (fds[i].revents & ~POLLOUT) != 0;
+#endif
+
+    /* the callbacks may unwatch descriptors, look them up again */
+    for( j=0; output && j<self->num_watches; j++ ) {
+      watch = &self->watches[j];
+      if(watch->fd == fd) {
+	if(watch->writable != NULL)
+	  watch->writable(fd, watch->data);
+	break;
+      }
+    }
+
+    for( j=0; input && j<self->num_watches; j++ ) {
+      watch = &self->watches[j];
+      if(watch->fd == fd) {
+	if(watch->callback != NULL)
+	  watch->callback(fd, watch->data);
+	break;
+      }
+    }
+  }
+
+  loop_expire(self);
+}
+
+void loop_free(Loop_t *self) {
+  if(self == NULL)
+    return;
+
+  if(self->epoll != -1)
+    close(self->epoll);
+  free(self);
+}
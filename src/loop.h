@@ -0,0 +1,48 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#define LOOP_MAX_WATCHES 16
+
+typedef struct LoopTimer {
+  long deadline;
+  int armed;
+  int fired;
+  void (*callback)(struct LoopTimer *timer, void *data);
+  void *data;
+  struct LoopTimer *next;
+} LoopTimer_t;
+
+typedef struct LoopWatch {
+  int fd;
+  void (*callback)(int fd, void *data);
+  void (*writable)(int fd, void *data);
+  void *data;
+} LoopWatch_t;
+
+typedef struct Loop {
+  int epoll;
+  LoopWatch_t watches[LOOP_MAX_WATCHES];
+  int num_watches;
+  LoopTimer_t *timers;
+  void (*idle)(void *data);
+  void *idle_data;
+} Loop_t;
+
+Loop_t *loop_new(void);
+void loop_watch(Loop_t *self, int fd, 
+		void (*callback)(int fd, void *data), void *data);
+void loop_unwatch(Loop_t *self, int fd);
+void loop_on_writable(Loop_t *self, int fd, 
+		      void (*writable)(int fd, void *data));
+void loop_on_idle(Loop_t *self, void (*callback)(void *data), void *data);
+void loop_timer_init(LoopTimer_t *timer, 
+		     void (*callback)(LoopTimer_t *timer, void *data), 
+		     void *data);
+void loop_arm(Loop_t *self, LoopTimer_t *timer, long usec);
+void loop_arm_at(Loop_t *self, LoopTimer_t *timer, long deadline);
+void loop_disarm(Loop_t *self, LoopTimer_t *timer);
+void loop_expire(Loop_t *self);
+void loop_wait(Loop_t *self);
+void loop_free(Loop_t *self);
+
+#endif /* #ifndef LOOP_H */
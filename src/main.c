@@ -0,0 +1,46 @@
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 500
+#endif /* _XOPEN_SOURCE */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <X11/Xlib.h>
+
+#include "arena.h"
+#include "loop.h"
+#include "launcher.h"
+#include "stats.h"
+#include "xchainkeys.h"
+
+extern XChainKeys_t *xc;
+
+int main(int argc, char **argv) {
+
+  /* the reload thread looks up keysyms while the main thread talks
+   * to the server, so Xlib has to lock, see xc_read_config() */
+  XInitThreads();
+
+  xc = xc_new();
+
+  xc_parse_options(xc, argc, argv);
+
+  if(xc->show_keys) {
+    xc_open_display(xc);
+    xc_show_keys(xc);
+    exit(EXIT_SUCCESS);
+  }
+
+  /* fork the launcher before connecting to the X server */
+  if(xc->launcher)
+    launcher_start_helper();
+
+  xc_open_display(xc);
+
+  if(xc->socket != NULL)
+    stats_listen(xc->stats, xc->socket, xc->loop);
+
+  xc_parse_config(xc);
+  xc_mainloop(xc);
+
+  exit(EXIT_SUCCESS);
+}
@@ -11,7 +11,13 @@
 #include <X11/Xutil.h>
 #include <X11/Xresource.h>
 
+#include "loop.h"
+#include "stats.h"
+#include "backend.h"
 #include "popup.h"
+#include "xchainkeys.h"
+
+extern XChainKeys_t *xc;
 
 void* popup_new(Display *display, char *font, char *fg, char *bg, char *position) {
 
@@ -25,27 +31,24 @@ void* popup_new(Display *display, char *font, char *fg, char *bg, char *position
   winattrs.override_redirect = True;
   winattrs.cursor = popup_get_cursor(self);
 
-  self->window = XCreateWindow(self->display, 
-			    self->root,
-			    0, 0, 1, 1, 2, 
-			    CopyFromParent, 
-			    InputOutput, 
-			    CopyFromParent, 
-			    CWOverrideRedirect | CWCursor,
-			    &winattrs); 
+  self->window = backend_create_window(self->display, self->root,
+				       CWOverrideRedirect | CWCursor,
+				       &winattrs); 
   
   Colormap colormap = DefaultColormap(self->display, 0);
+  XColor colors[2];
   XColor fgcolor;
   XColor bgcolor;
 
-  XParseColor(self->display, colormap, fg, &fgcolor);
-  XAllocColor(self->display, colormap, &fgcolor);
+  backend_parse_color(self->display, colormap, fg, &colors[0]);
+  backend_parse_color(self->display, colormap, bg, &colors[1]);
+  backend_alloc_colors(self->display, colormap, colors, 2);
 
-  XParseColor(self->display, colormap, bg, &bgcolor);
-  XAllocColor(self->display, colormap, &bgcolor);
+  fgcolor = colors[0];
+  bgcolor = colors[1];
 
-  XSetWindowBorder(self->display, self->window, fgcolor.pixel);
-  XSetWindowBackground(self->display, self->window, bgcolor.pixel);
+  backend_set_window_colors(self->display, self->window, 
+			    fgcolor.pixel, bgcolor.pixel);
 
   XGCValues values;
   values.cap_style = CapButt;
@@ -55,28 +58,41 @@ void* popup_new(Display *display, char *font, char *fg, char *bg, char *position
 
   unsigned long valuemask = GCCapStyle | GCJoinStyle;
   
-  self->gc = XCreateGC(self->display, self->window, valuemask, &values);
+  self->gc = backend_create_gc(self->display, self->window, valuemask, &values);
   if (self->gc < 0) {
     printf("XCreateGC: \n");
     exit(EXIT_FAILURE);
   }
-  XSetForeground(self->display, self->gc, fgcolor.pixel);
+  backend_set_foreground(self->display, self->gc, fgcolor.pixel);
 
-  self->font = XLoadQueryFont(self->display, font);
+  self->font = backend_load_font(self->display, self->gc, font);
   if (!self->font) {
     fprintf(stderr, "%s: error: XLoadQueryFont: failed to load font '%s'\n", 
 	    PACKAGE_NAME, font);
     exit(EXIT_FAILURE);
   }
-  XSetFont(self->display, self->gc, self->font->fid);
 
-  self->timeout = 0;
+  self->buffer[0] = '\0';
+  self->text = self->buffer;
+
+  strncpy(self->font_name, font, sizeof(self->font_name) - 1);
+  strncpy(self->fg, fg, sizeof(self->fg) - 1);
+  strncpy(self->bg, bg, sizeof(self->bg) - 1);
+
   self->mapped = False;
   self->w = self->h = 1;
 
   return self;
 }
 
+int popup_matches(Popup_t *self, char *font, char *fg, char *bg) {
+
+  /* whether this popup looks as requested, so it can be kept */
+  return strcmp(self->font_name, font) == 0 &&
+    strcmp(self->fg, fg) == 0 &&
+    strcmp(self->bg, bg) == 0;
+}
+
 void popup_update(Popup_t *self) {
   
   int margin = 3;
@@ -89,8 +105,6 @@ void popup_update(Popup_t *self) {
 
   int x, y = 0;
   unsigned int ignored_width, ignored_height;
-  Window root, child;
-  unsigned int mask;
 
   self->x = 0;
   self->y = 0;
@@ -111,8 +125,7 @@ void popup_update(Popup_t *self) {
   }
   else if (strncmp(self->position, "mouse", 5) == 0) {
 
-    XQueryPointer(self->display, self->root, &root, &child,
-		  &self->x, &self->y, &x, &y, &mask);
+    backend_query_pointer(self->display, self->root, &self->x, &self->y);
   }
   else if(strlen(self->position) > 0) {
     self->x = atoi(self->position);
@@ -134,69 +147,39 @@ void popup_update(Popup_t *self) {
   if (self->y > dh - (self->h + margin))
     self->y = dh - self->h - margin;
 
-  XMoveResizeWindow(self->display, self->window,
-		    self->x, self->y, self->w, self->h);
+  backend_move_resize_window(self->display, self->window,
+			     self->x, self->y, self->w, self->h);
 
-  XClearArea(self->display, self->window,
-	     0, 0, 0, 0,False);
-  XFlush(self->display);
+  backend_clear_window(self->display, self->window);
+  backend_flush(self->display);
 
-  XDrawString(self->display, self->window, self->gc,
-	      margin, self->h - margin*2, 
-	      self->text, strlen(self->text));
+  backend_draw_string(self->display, self->window, self->gc,
+		      margin, self->h - margin*2, self->text);
+  xc->stats->redraws++;
 
-  XFlush(self->display);
+  backend_flush(self->display);
 }
 
 void popup_show(Popup_t *self) {
   if(self->enabled) {
-    XMapWindow(self->display, self->window);
-    XRaiseWindow(self->display, self->window);
+    backend_map_window(self->display, self->window);
     self->mapped = True;
     popup_update(self);
   }
 }
 
 void popup_hide(Popup_t *self) {
-  XUnmapWindow(self->display, self->window);
+  backend_unmap_window(self->display, self->window);
   self->mapped = False;
-  XFlush(self->display);
-}
-
-void popup_set_timeout(Popup_t *self, unsigned int ms) {
-  struct timeval tval;
-  unsigned int now;
-
-  gettimeofday(&tval, NULL);
-  now =(long)(tval.tv_sec*1000 + (tval.tv_usec/1000));
-  self->timeout = now + ms;
+  backend_flush(self->display);
 }
 
 Cursor popup_get_cursor(Popup_t *self) {
-
-  Pixmap mask;
-  GC gc;
-  XGCValues values;
-  XColor color;
-  Cursor cursor;
-
-  mask = XCreatePixmap(self->display, self->root, 1, 1, 1);
-  values.function = GXclear;
-  gc = XCreateGC(self->display, mask, GCFunction, &values);
-
-  XFillRectangle(self->display, mask, gc, 0, 0, 1, 1);
-  color.pixel = 0; color.red = 0; color.flags = 04;
-
-  cursor = XCreatePixmapCursor(self->display, mask, mask,
-			       &color,&color, 0,0);
-
-  XFreePixmap(self->display, mask);
-  XFreeGC(self->display, gc);
-  return cursor;
+  return backend_create_blank_cursor(self->display, self->root);
 }
 
 void popup_free(Popup_t *self) {
-  XFreeFont(self->display, self->font);
-  XFreeGC(self->display, self->gc);
+  backend_free_font(self->display, self->font);
+  backend_free_gc(self->display, self->gc);
   free(self);
 }
@@ -8,16 +8,19 @@ typedef struct Popup {
   XFontStruct *font;
   GC gc;
   int x, y, w, h;
-  char text[4096];
+  char *text;
+  char buffer[4096];
   char *position;
-  unsigned int timeout;
+  char font_name[512];
+  char fg[64];
+  char bg[64];
   int mapped;
   int enabled;
 } Popup_t;
 
 void* popup_new(Display *display, char *font, char *fg, char *bg, char *position);
 Cursor popup_get_cursor(Popup_t *self);
-void popup_set_timeout(Popup_t *self, unsigned int ms);
+int popup_matches(Popup_t *self, char *font, char *fg, char *bg);
 void popup_update(Popup_t *self);
 void popup_show(Popup_t *self);
 void popup_hide(Popup_t *self);
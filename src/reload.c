@@ -0,0 +1,115 @@
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 500
+#endif /* _XOPEN_SOURCE */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <X11/Xlib.h>
+
+#include "loop.h"
+#include "xchainkeys.h"
+#include "reload.h"
+
+/* Reloading reads the config file on a worker thread, while the main
+ * thread keeps handling keys with the running bindings. The worker
+ * only touches the Config_t it was handed, and writes a byte to a
+ * pipe when it's done. The main loop then joins it and xc_mainloop()
+ * picks up the result with reload_take() between two keys. */
+
+Reload_t *reload_new(Loop_t *loop) {
+  Reload_t *self = (Reload_t *) calloc(1, sizeof(Reload_t));
+
+  self->running = False;
+  self->done = False;
+  self->ok = False;
+  self->config = NULL;
+
+  if (pipe(self->pipe) == -1) {
+    fprintf(stderr, "%s: error: pipe() failed: %s\n", PACKAGE_NAME,
+	    strerror(errno));
+    fflush(stderr);
+    exit(EXIT_FAILURE);
+  }
+  fcntl(self->pipe[0], F_SETFD, FD_CLOEXEC);
+  fcntl(self->pipe[1], F_SETFD, FD_CLOEXEC);
+
+  loop_watch(loop, self->pipe[0], reload_finish, self);
+  return self;
+}
+
+static void *reload_thread(void *data) {
+  Reload_t *self = (Reload_t *) data;
+
+  self->ok = xc_read_config(self->config);
+
+  /* wake up the main loop, which joins this thread */
+  while (write(self->pipe[1], "r", 1) == -1 && errno == EINTR)
+    ;
+  return NULL;
+}
+
+int reload_start(Reload_t *self, Config_t *config) {
+  sigset_t all, mask;
+  int error;
+
+  if (self->running || self->done)
+    return False;
+
+  self->config = config;
+  self->ok = False;
+
+  /* signals are handled by the main thread, don't let the worker
+   * inherit their delivery */
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &mask);
+  error = pthread_create(&self->thread, NULL, reload_thread, self);
+  pthread_sigmask(SIG_SETMASK, &mask, NULL);
+
+  if (error != 0) {
+    fprintf(stderr, "%s: error: failed to start reload thread: %s\n",
+	    PACKAGE_NAME, strerror(error));
+    fflush(stderr);
+    self->config = NULL;
+    return False;
+  }
+  self->running = True;
+  return True;
+}
+
+int reload_busy(Reload_t *self) {
+  return self->running || self->done;
+}
+
+int reload_ready(Reload_t *self) {
+  return self->done;
+}
+
+void reload_finish(int fd, void *data) {
+  Reload_t *self = (Reload_t *) data;
+  char byte;
+
+  if (read(fd, &byte, 1) != 1 || !self->running)
+    return;
+
+  pthread_join(self->thread, NULL);
+  self->running = False;
+  self->done = True;
+}
+
+Config_t *reload_take(Reload_t *self, int *ok) {
+  Config_t *config = self->config;
+
+  if (!self->done)
+    return NULL;
+
+  *ok = self->ok;
+  self->config = NULL;
+  self->done = False;
+  return config;
+}
@@ -0,0 +1,21 @@
+#ifndef RELOAD_H
+#define RELOAD_H
+
+/* a config file read on a worker thread, see reload.c */
+typedef struct Reload {
+  pthread_t thread;
+  int running;
+  int done;
+  int ok;
+  int pipe[2];
+  struct Config *config;
+} Reload_t;
+
+Reload_t *reload_new(Loop_t *loop);
+int reload_start(Reload_t *self, struct Config *config);
+int reload_busy(Reload_t *self);
+int reload_ready(Reload_t *self);
+struct Config *reload_take(Reload_t *self, int *ok);
+void reload_finish(int fd, void *data);
+
+#endif /* #ifndef RELOAD_H */
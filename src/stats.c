@@ -0,0 +1,224 @@
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 500
+#endif /* _XOPEN_SOURCE */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <X11/Xlib.h>
+
+#include "loop.h"
+#include "stats.h"
+#include "backend.h"
+#include "xchainkeys.h"
+
+extern XChainKeys_t *xc;
+
+/* Counters are plain increments on the main thread, and each binding
+ * keeps a pointer to the counters of its path, so counting costs no
+ * lookups while handling keys. The counters of a path survive
+ * reloads, just like the launcher's accounts. */
+
+Stats_t *stats_new(void) {
+  Stats_t *self = (Stats_t *) calloc(1, sizeof(Stats_t));
+
+  self->paths = NULL;
+  self->num_paths = 0;
+  self->max_paths = 0;
+  self->index = NULL;
+  self->index_size = 0;
+  self->socket = -1;
+
+  return self;
+}
+
+static unsigned int stats_hash(char *path) {
+  unsigned int hash = 2166136261u;
+
+  while (*path)
+    hash = (hash ^ (unsigned char) *path++) * 16777619u;
+  return hash;
+}
+
+static void stats_index(Stats_t *self) {
+  unsigned int mask;
+  unsigned int slot;
+  int i;
+
+  /* open addressing, rebuilt whenever it gets half full */
+  self->index_size = (self->index_size == 0) ? 256 : self->index_size * 2;
+  free(self->index);
+  self->index = (int *) calloc(self->index_size, sizeof(int));
+  mask = self->index_size - 1;
+
+  for (i = 0; i < self->index_size; i++)
+    self->index[i] = -1;
+
+  for (i = 0; i < self->num_paths; i++) {
+    slot = stats_hash(self->paths[i]->path) & mask;
+    while (self->index[slot] != -1)
+      slot = (slot + 1) & mask;
+    self->index[slot] = i;
+  }
+}
+
+StatsPath_t *stats_lookup(Stats_t *self, char *path) {
+  StatsPath_t *stats;
+  unsigned int mask;
+  unsigned int slot;
+
+  if (self->index_size == 0)
+    stats_index(self);
+
+  mask = self->index_size - 1;
+  slot = stats_hash(path) & mask;
+
+  while (self->index[slot] != -1) {
+    stats = self->paths[self->index[slot]];
+    if (strcmp(stats->path, path) == 0)
+      return stats;
+    slot = (slot + 1) & mask;
+  }
+
+  if (self->num_paths == self->max_paths) {
+    self->max_paths = (self->max_paths == 0) ? 64 : self->max_paths * 2;
+    self->paths = (StatsPath_t **)
+      realloc(self->paths, self->max_paths * sizeof(StatsPath_t *));
+  }
+
+  stats = (StatsPath_t *) calloc(1, sizeof(StatsPath_t));
+  stats->path = strdup(path);
+
+  self->index[slot] = self->num_paths;
+  self->paths[self->num_paths++] = stats;
+
+  if (self->num_paths * 2 > self->index_size)
+    stats_index(self);
+
+  return stats;
+}
+
+void stats_latency(StatsPath_t *path, long usec) {
+  int bucket = 0;
+
+  while (usec > 0 && bucket < STATS_BUCKETS - 1) {
+    usec >>= 1;
+    bucket++;
+  }
+  path->latency[bucket]++;
+}
+
+void stats_dump(Stats_t *self, FILE *file) {
+  StatsPath_t *stats;
+  int last;
+  int i, j;
+
+  /* tab separated, the counters of the daemon first, then one line
+   * for each binding path that has been used */
+  fprintf(file, "# counter\tvalue\n");
+  fprintf(file, "events\t%lu\n", self->events);
+  fprintf(file, "key_grabs\t%lu\n", self->key_grabs);
+  fprintf(file, "keyboard_grabs\t%lu\n", self->keyboard_grabs);
+  fprintf(file, "round_trips\t%lu\n", backend_round_trips());
+  fprintf(file, "redraws\t%lu\n", self->redraws);
+  fprintf(file, "reloads\t%lu\n", self->reloads);
+
+  fprintf(file, "# path\tactivations\tentries\ttimeouts\taborts\tmisses\t"
+	  "launches\tlatency_us\n");
+
+  for (i = 0; i < self->num_paths; i++) {
+    stats = self->paths[i];
+
+    if (stats->activations == 0 && stats->timeouts == 0)
+      continue;
+
+    fprintf(file, "%s\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t",
+	    stats->path, stats->activations, stats->entries,
+	    stats->timeouts, stats->aborts, stats->misses, stats->launches);
+
+    /* the histogram, up to the last bucket in use */
+    for (last = STATS_BUCKETS - 1; last > 0; last--) {
+      if (stats->latency[last] > 0)
+	break;
+    }
+    for (j = 0; j <= last; j++)
+      fprintf(file, (j == 0) ? "%lu" : ",%lu", stats->latency[j]);
+    fprintf(file, "\n");
+  }
+  fflush(file);
+}
+
+int stats_listen(Stats_t *self, char *path, Loop_t *loop) {
+  struct sockaddr_un address;
+  int fd;
+
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "%s: error: socket path too long: '%s'\n",
+	    PACKAGE_NAME, path);
+    fflush(stderr);
+    return False;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+
+  /* a socket left behind by a previous instance */
+  unlink(path);
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 ||
+      bind(fd, (struct sockaddr *) &address, sizeof(address)) == -1 ||
+      listen(fd, 4) == -1) {
+
+    fprintf(stderr, "%s: error: failed to listen on '%s': %s\n",
+	    PACKAGE_NAME, path, strerror(errno));
+    fflush(stderr);
+
+    if (fd != -1)
+      close(fd);
+    return False;
+  }
+
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  /* clients may go away before reading the dump. Commands get the
+   * default action back, see launcher_spawn() */
+  signal(SIGPIPE, SIG_IGN);
+
+  self->socket = fd;
+
+  loop_watch(loop, fd, stats_accept, self);
+  return True;
+}
+
+void stats_accept(int fd, void *data) {
+  struct timeval timeout;
+  FILE *file;
+  int client;
+
+  /* every connection gets one dump, then it is closed */
+  while ((client = accept(fd, NULL, NULL)) != -1) {
+
+    fcntl(client, F_SETFD, FD_CLOEXEC);
+
+    /* don't let a stalled reader block the daemon for long */
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 100000;
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    if ((file = fdopen(client, "w")) == NULL) {
+      close(client);
+      continue;
+    }
+    xc_dump(xc, file);
+    fclose(file);
+  }
+}
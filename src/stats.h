@@ -0,0 +1,41 @@
+#ifndef STATS_H
+#define STATS_H
+
+/* latencies are counted in buckets of powers of two microseconds:
+ * bucket 0 holds 0 usec, bucket i holds 2^(i-1) to 2^i - 1 usec and
+ * the last bucket everything above */
+#define STATS_BUCKETS 24
+
+typedef struct StatsPath {
+  char *path;
+  unsigned long activations;
+  unsigned long entries;
+  unsigned long timeouts;
+  unsigned long aborts;
+  unsigned long misses;
+  unsigned long launches;
+  unsigned long latency[STATS_BUCKETS];
+} StatsPath_t;
+
+typedef struct Stats {
+  unsigned long events;
+  unsigned long key_grabs;
+  unsigned long keyboard_grabs;
+  unsigned long redraws;
+  unsigned long reloads;
+  StatsPath_t **paths;
+  int num_paths;
+  int max_paths;
+  int *index;
+  int index_size;
+  int socket;
+} Stats_t;
+
+Stats_t *stats_new(void);
+StatsPath_t *stats_lookup(Stats_t *self, char *path);
+void stats_latency(StatsPath_t *path, long usec);
+void stats_dump(Stats_t *self, FILE *file);
+int stats_listen(Stats_t *self, char *path, Loop_t *loop);
+void stats_accept(int fd, void *data);
+
+#endif /* #ifndef STATS_H */
@@ -1,14 +1,65 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <sys/time.h>
 #include <X11/Xlib.h>
 
 #include "key.h"
+#include "log.h"
+#include "backend.h"
 #include "xchainkeys.h"
 
 extern XChainKeys_t *xc;
 
+#ifdef XC_DEBUG
+
+/* Debug builds count all heap allocations, including those made by
+ * Xlib and libc, by wrapping the glibc allocator. */
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long allocs = 0;
+
+void *malloc(size_t size) {
+  allocs++;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  allocs++;
+  return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  allocs++;
+  return __libc_realloc(ptr, size);
+}
+
+unsigned long get_allocs(void) {
+  return allocs;
+}
+
+void report_allocs(char *what, unsigned long since) {
+  unsigned long count = allocs - since;
+
+  log_printf(xc->log, LOG_LEVEL_DEBUG, "%s: %lu heap allocations\n", 
+	     what, count);
+}
+
+#else
+
+unsigned long get_allocs(void) {
+  return 0;
+}
+
+void report_allocs(char *what, unsigned long since) {
+}
+
+#endif /* XC_DEBUG */
+
 void version() {
   printf("%s %s Copyright (C) 2010-2012 Henning Bekel <%s>\n",
 	 PACKAGE_NAME, PACKAGE_VERSION, PACKAGE_BUGREPORT);
@@ -25,13 +76,47 @@ void usage() {
   printf("Usage: %s [options]\n\n", PACKAGE_NAME);
   printf("  -f, --file    : alternative config file\n");
   printf("  -k, --keys    : Show valid keyspecs\n");
+  printf("  -l, --launcher: Spawn commands from a helper process\n");
+  printf("  -s, --socket  : Send statistics to clients of this socket\n");
   printf("  -d, --debug   : Enable debug messages\n");
+  printf("  -L, --log-level: Log quiet, info or debug messages\n");
+  printf("  -t, --trace   : Write binary log records to this file\n");
   printf("  -h, --help    : Print this help text\n");
   printf("  -v, --version : Print version information\n");
   printf("\n");
   fflush(stdout);
 }
 
+int is_autorepeat(XEvent *event) {
+  int repeat = False;
+
+  /* a held key either repeats KeyPress events only (detectable
+   * autorepeat), or pairs of KeyRelease and KeyPress events sharing
+   * the same timestamp */
+  if (event->type != KeyPress && event->type != KeyRelease)
+    return False;
+
+  if (event->type == KeyPress && 
+      event->xkey.keycode == xc->last_key.keycode &&
+      (xc->last_key.type == KeyPress || 
+       event->xkey.time == xc->last_key.time))
+    repeat = True;
+
+  xc->last_key = event->xkey;
+  return repeat;
+}
+
+int events_pending(Display *display) {
+
+  /* events Xlib has already read are handled right away, without
+   * flushing or reading the connection.  Otherwise flush our requests
+   * and read whatever has arrived, before the caller goes to sleep */
+  if (backend_events_queued(display) > 0)
+    return True;
+
+  return backend_pending(display) > 0;
+}
+
 unsigned int modname_to_modifier(char *str) {
 
   if( strcasecmp(str, "shift") == 0 || 
@@ -73,59 +158,77 @@ unsigned int modname_to_modifier(char *str) {
   return 0;
 }
 
-unsigned int keycode_to_modifier(XModifierKeymap *xmodmap, KeyCode keycode) {
+void init_modifier_table(XModifierKeymap *xmodmap, unsigned int *table) {
+
+  /* map each keycode to the modifier it is assigned to, so that
+   * keycode_to_modifier() is a simple table lookup. The modifier map
+   * holds max_keypermod keycodes for each of the eight modifiers, in
+   * the order Shift, Lock, Control, Mod1 ... Mod5, which is the order
+   * of the corresponding mask bits. */
 
   int i = 0;
   int j = 0;
   int max = xmodmap->max_keypermod;
+  KeyCode keycode;
+
+  memset(table, 0, 256 * sizeof(unsigned int));
 
   for (i = 0; i < 8; i++) {
     for (j = 0; j < max && xmodmap->modifiermap[(i * max) + j]; j++) {
-      if (keycode == xmodmap->modifiermap[(i * max) + j]) {
-        switch (i) {
-          case ShiftMapIndex: return ShiftMask; break;
-          case LockMapIndex: return LockMask; break;
-          case ControlMapIndex: return ControlMask; break;
-          case Mod1MapIndex: return Mod1Mask; break;
-          case Mod2MapIndex: return Mod2Mask; break;
-          case Mod3MapIndex: return Mod3Mask; break;
-          case Mod4MapIndex: return Mod4Mask; break;
-          case Mod5MapIndex: return Mod5Mask; break;
-        }
-      } 
-    } 
-  } 
-  return (KeyCode) 0;
+      keycode = xmodmap->modifiermap[(i * max) + j];
+
+      /* a keycode bound to several modifiers reports the first one */
+      if (table[keycode] == 0)
+	table[keycode] = 1 << i;
+    }
+  }
+}
+
+unsigned int keycode_to_modifier(KeyCode keycode) {
+  return xc->modifier_table[keycode];
 }
 
 unsigned int get_modifiers(Display *display) {
 
+  /* query the modifier keys currently held down from the server. This
+   * costs a round trip and is only used if 'modifiers query' has been
+   * configured, see get_event_modifiers() */
+
   char keymap[32]; 
   unsigned int keycode;
   unsigned int modifiers = 0;
 
-  XQueryKeymap(display, keymap);
+  backend_query_keymap(display, keymap);
 
   for (keycode = 0; keycode < 256; keycode++) {
-    if ((keymap[(keycode / 8)] & (1 << (keycode % 8))) \
-        && keycode_to_modifier(xc->xmodmap, keycode)) {
-
-      modifiers |= keycode_to_modifier(xc->xmodmap, keycode);
+    if (keymap[(keycode / 8)] & (1 << (keycode % 8))) {
+      modifiers |= keycode_to_modifier(keycode);
     }
   }
   return modifiers;
 }
 
+unsigned int get_event_modifiers(XKeyEvent *event) {
+
+  /* the modifiers in effect for a key event, ignoring num, caps and
+   * scroll lock just like the grabs do */
+
+  if (xc->query_modifiers)
+    return get_modifiers(event->display) & XC_MODIFIERS & ~xc->lockmask;
+
+  return event->state & XC_MODIFIERS & ~xc->lockmask;
+}
+
 void send_key(Display *display, Key_t *key, Window window) {
 
   XKeyEvent e;
   char *keyspec;
 
-  if (xc->debug) {
+  if (xc->log->level >= LOG_LEVEL_DEBUG) {
     keyspec = key_to_str(key);
-      printf("Sending synthetic KeyPressEvent (%s) to window id %d\n", 
-	      keyspec, (int)window);
-      fflush(stdout);
+    log_printf(xc->log, LOG_LEVEL_DEBUG, 
+	       "Sending synthetic KeyPressEvent (%s) to window id %d\n", 
+	       keyspec, (int)window);
     free(keyspec);
   }
 
@@ -139,8 +242,13 @@ void send_key(Display *display, Key_t *key, Window window) {
   e.type = KeyPress;
   e.x = e.y = e.x_root = e.y_root = 1;
   
-  XSendEvent(display, e.window, True, KeyPressMask, (XEvent *)&e);
-  XSync(display, False);
+  backend_send_key_event(display, &e);
+}
+
+long get_usec(void) {
+
+  /* the monotonic clock, or the virtual one of the fake backend */
+  return backend_usec();
 }
 
 long get_msec(void) {
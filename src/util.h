@@ -4,9 +4,16 @@
 void usage(void);
 void version(void);
 unsigned int get_modifiers(Display *display);
+unsigned int get_event_modifiers(XKeyEvent *event);
+int is_autorepeat(XEvent *event);
+int events_pending(Display *display);
 unsigned int modname_to_modifier(char *str);
-unsigned int keycode_to_modifier(XModifierKeymap *xmodmap, KeyCode keycode);
+void init_modifier_table(XModifierKeymap *xmodmap, unsigned int *table);
+unsigned int keycode_to_modifier(KeyCode keycode);
 void send_key(Display *display, Key_t *key, Window window);
 long get_msec(void);
+long get_usec(void);
+unsigned long get_allocs(void);
+void report_allocs(char *what, unsigned long since);
 
 #endif /* ifndef XCHAINKEYS_H */
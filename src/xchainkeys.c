@@ -31,12 +31,23 @@
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
+#include <fcntl.h>
 #include <sys/time.h>
+#include <pthread.h>
 #include <X11/Xlib.h>
 
+#include "arena.h"
 #include "key.h"
 #include "binding.h"
+#include "automaton.h"
 #include "popup.h"
+#include "loop.h"
+#include "grab.h"
+#include "launcher.h"
+#include "stats.h"
+#include "log.h"
+#include "reload.h"
+#include "backend.h"
 #include "util.h"
 #include "xchainkeys.h"
 
@@ -46,30 +57,19 @@ XChainKeys_t* xc_new() {
 
   XChainKeys_t *self = (XChainKeys_t *) calloc(1, sizeof(XChainKeys_t)); 
 
-  if(NULL == (self->display=XOpenDisplay(NULL))) {
-    
-    fprintf(stderr, "%s: error: XOpenDisplay() failed for DISPLAY=%s.\n", 
-	    PACKAGE_NAME, getenv("DISPLAY")); 
-    fflush(stderr);
-    
-    free(self);
-    exit(EXIT_FAILURE);
-  }
-
-  XSetErrorHandler(xc_handle_error);
-
-  self->debug = False;
+  self->log = log_new();
+  self->show_keys = False;
+  self->launcher = False;
   self->timeout = 3000;
   self->delay = 1000;
   self->hold = -1;
-  self->position = "center";
+  self->position = strdup("center");
   self->reentry = NULL;
+  self->unwind = False;
+  self->repeat = False;
   self->reload = False;
 
-  self->xmodmap = XGetModifierMapping(self->display);
-  xc_init_modmask(self);
-
-  self->connection = ConnectionNumber(self->display);
+  self->query_modifiers = False;
 
   self->action_names[0] = ":none";
   self->action_names[1] = ":enter";
@@ -80,14 +80,69 @@ XChainKeys_t* xc_new() {
   self->action_names[6] = ":load";
   self->action_names[7] = ":wait";
 
-  self->root = binding_new();
-  self->root->action = XC_ACTION_NONE;
+  self->arena = NULL;
+  self->root = NULL;
+  self->automaton = NULL;
+  self->compile = True;
+
+  self->grabs = grab_set_new();
+  self->stats = stats_new();
+  self->socket = NULL;
   
   xc_find_config(self);
 
   return self;
 }
 
+void xc_open_display(XChainKeys_t *self) {
+
+  if(NULL == (self->display=backend_open_display(NULL))) {
+    
+    fprintf(stderr, "%s: error: XOpenDisplay() failed for DISPLAY=%s.\n", 
+	    PACKAGE_NAME, getenv("DISPLAY")); 
+    fflush(stderr);
+    
+    exit(EXIT_FAILURE);
+  }
+
+  XSetErrorHandler(xc_handle_error);
+
+  self->xmodmap = backend_get_modifier_mapping(self->display);
+  xc_init_modmask(self);
+
+  self->connection = ConnectionNumber(self->display);
+
+  /* don't leak the X connection into spawned commands */
+  fcntl(self->connection, F_SETFD, 
+	fcntl(self->connection, F_GETFD) | FD_CLOEXEC);
+
+  /* X events are read by the callers of loop_wait() */
+  self->loop = loop_new();
+  loop_on_idle(self->loop, log_idle, self->log);
+  loop_watch(self->loop, self->connection, NULL, NULL);
+
+  self->reloader = reload_new(self->loop);
+
+  self->delay_timer = (LoopTimer_t *) calloc(1, sizeof(LoopTimer_t));
+  loop_timer_init(self->delay_timer, xc_show_popup, self);
+
+  self->hold_timer = (LoopTimer_t *) calloc(1, sizeof(LoopTimer_t));
+  loop_timer_init(self->hold_timer, xc_hide_popup, self);
+}
+
+void xc_show_popup(LoopTimer_t *timer, void *data) {
+  XChainKeys_t *self = (XChainKeys_t *) data;
+
+  if(!self->popup->mapped)
+    popup_show(self->popup);
+}
+
+void xc_hide_popup(LoopTimer_t *timer, void *data) {
+  XChainKeys_t *self = (XChainKeys_t *) data;
+
+  popup_hide(self->popup);
+}
+
 void xc_init_modmask(XChainKeys_t *self) {
   unsigned int num, caps, scroll;
 
@@ -97,16 +152,18 @@ void xc_init_modmask(XChainKeys_t *self) {
    * Xchainkeys ignores these modifiers by default, e.g. each key will
    * be bound to all possible combinations */
 
+  init_modifier_table(self->xmodmap, self->modifier_table);
+
   /* get the keycodes for num, caps and scroll lock */
   num = 
-    keycode_to_modifier(self->xmodmap, 
-			XKeysymToKeycode(self->display, XStringToKeysym("Num_Lock")));
+    self->modifier_table[backend_keysym_to_keycode(self->display,
+					  XStringToKeysym("Num_Lock"))];
   caps = 
-    keycode_to_modifier(self->xmodmap, 
-			XKeysymToKeycode(self->display, XStringToKeysym("Caps_Lock")));
+    self->modifier_table[backend_keysym_to_keycode(self->display,
+					  XStringToKeysym("Caps_Lock"))];
   scroll = 
-    keycode_to_modifier(self->xmodmap, 
-			XKeysymToKeycode(self->display, XStringToKeysym("Scoll_Lock")));
+    self->modifier_table[backend_keysym_to_keycode(self->display,
+					  XStringToKeysym("Scroll_Lock"))];
 
   /* populate modmask array with all possible combinations */
   self->modmask[0] = 0;
@@ -117,6 +174,8 @@ void xc_init_modmask(XChainKeys_t *self) {
   self->modmask[5] = num | scroll;
   self->modmask[6] = caps | scroll;
   self->modmask[7] = num | caps | scroll;
+
+  self->lockmask = num | caps | scroll;
 }
 
 int xc_handle_error(Display *display, XErrorEvent *event ) {
@@ -145,7 +204,7 @@ void xc_show_keys(XChainKeys_t *self) {
   char *keystr = "";
   char *keyspec = "";
 
-  if(!xc->debug) {
+  if(xc->log->level == LOG_LEVEL_QUIET) {
     version();
     printf("\n");
   }
@@ -154,13 +213,12 @@ void xc_show_keys(XChainKeys_t *self) {
   printf("Press Control-c to quit.\n\n");
   fflush(stdout);
 
-  XGrabKeyboard(self->display, DefaultRootWindow(self->display),
-		True, GrabModeAsync, GrabModeAsync, CurrentTime);
+  backend_grab_keyboard(self->display);
 
   while(True) {
     
     /* block until an event occurs */
-    XNextEvent(self->display, &event);
+    backend_next_event(self->display, &event);
     
     /* we're only interested in KeyPress events */
     if (event.type == KeyPress) {
@@ -168,10 +226,10 @@ void xc_show_keys(XChainKeys_t *self) {
       keycode = ((XKeyPressedEvent*)&event)->keycode;
       
       /* skip modifier key press */
-      if(keycode_to_modifier(xc->xmodmap, keycode) != 0) 
+      if(keycode_to_modifier(keycode) != 0) 
 	continue;
 
-      keysym = XKeycodeToKeysym(self->display, keycode, 0);
+      keysym = backend_keycode_to_keysym(self->display, keycode);
       
       /* get a string from keysym or keycode */
       if(keysym != NoSymbol)
@@ -181,9 +239,9 @@ void xc_show_keys(XChainKeys_t *self) {
 
       /* abort on Ctrl-c */
       if (strcmp(keystr, "c") == 0 && 
-	  get_modifiers(self->display) == ControlMask ) {
+	  get_event_modifiers(&event.xkey) == ControlMask ) {
 	
-	XUngrabKeyboard(self->display, CurrentTime);
+	backend_ungrab_keyboard(self->display);
 	return;
       }
       
@@ -191,7 +249,7 @@ void xc_show_keys(XChainKeys_t *self) {
        * pressed modifiers */
 
       key = key_new(keystr);
-      key->modifiers = get_modifiers(self->display);
+      key->modifiers = get_event_modifiers(&event.xkey);
       
       /* get the key specifier in Xchainkey format and print it */
       keyspec = key_to_str(key);
@@ -224,46 +282,100 @@ void xc_find_config(XChainKeys_t *self) {
 }
 
 void xc_parse_config(XChainKeys_t *self) {
+  Config_t *config = xc_new_config(self);
+
+  log_printf(self->log, LOG_LEVEL_INFO, "Parsing config file %s\n",
+	     config->file);
+
+  if(!xc_read_config(config))
+    exit(EXIT_FAILURE);
+
+  xc_resolve_config(self, config);
+  xc_apply_config(self, config);
+}
+
+Config_t *xc_new_config(XChainKeys_t *self) {
+  Config_t *config = (Config_t *) calloc(1, sizeof(Config_t));
+
+  strncpy(config->file, self->config, sizeof(config->file) - 1);
+  config->errors = 0;
+  config->arena = NULL;
+  config->root = NULL;
+
+  /* settings missing from the file keep their current values, except
+   * for those of the popup */
+  config->timeout = self->timeout;
+  config->delay = self->delay;
+  config->hold = self->hold;
+  config->query_modifiers = self->query_modifiers;
+  config->compile = self->compile;
+  config->feedback = True;
+  strncpy(config->position, self->position, sizeof(config->position) - 1);
+  strcpy(config->font, "fixed");
+  strcpy(config->fg, "black");
+  strcpy(config->bg, "white");
+
+  return config;
+}
+
+void xc_free_config(Config_t *config) {
+  if(config == NULL)
+    return;
+
+  arena_free(config->arena);
+  free(config);
+}
+
+int xc_read_config(Config_t *config) {
+
+  /* this runs on the reload thread as well, so it must not touch
+   * anything but the config: no X requests, no log messages and no
+   * statistics. xc_apply_config() does all that. The keysym lookups
+   * in Xlib are safe since main() calls XInitThreads(), and the
+   * launcher's PATH cache belongs to whichever thread is parsing:
+   * the main thread at startup, then the single reload worker, as
+   * nothing else uses it. */
 
   FILE *f;
   char *buffer = (char *) calloc(4096, sizeof(char));
   char *argument= (char *) calloc(4096, sizeof(char));
   char *argument_ptr = argument;
-  char *line, *token, *expect, *path;
+  char token[4096];
+  char *line, *expect, *path;
   const char *ws = " \t"; 
   int linenum = 0;
   int len, pos;
+  long start;
 
+  Arena_t *arena;
   Key_t *key;
+  Binding_t *root;
   Binding_t *binding;
   Binding_t *parent;
   Binding_t *existing;
 
-  int feedback = True;
-
-  char *font = calloc(512, sizeof(char));
-  strcpy(font, "fixed");
-
-  char *fg = calloc(64, sizeof(char));
-  strcpy(fg, "black");
-
-  char *bg = calloc(64, sizeof(char));
-  strcpy(bg, "white");
-
   /* try to open config file */
-  f = fopen(self->config, "r");
+  f = fopen(config->file, "r");
   
   if(f == NULL) {
     fprintf(stderr, "%s: error: '%s': %s\n", 
-	    PACKAGE_NAME, self->config, strerror(errno));
+	    PACKAGE_NAME, config->file, strerror(errno));
     fflush(stderr);
-    exit(EXIT_FAILURE);
+    free(buffer);
+    free(argument);
+    return False;
   }
 
-  if (self->debug) { 
-    printf("Parsing config file %s\n", self->config);
-    fflush(stdout);
-  }
+  start = get_usec();
+
+  /* look up the executables of commands in PATH anew */
+  launcher_flush_cache();
+
+  /* the new binding tree is built in an arena of its own, which
+   * replaces the previous one in xc_apply_config() */
+  arena = arena_new();
+  root = binding_new(arena);
+  root->action = XC_ACTION_NONE;
 
   /* parse file */
   while(fgets(buffer, 4096, f) != NULL) {
@@ -286,7 +398,7 @@ void xc_parse_config(XChainKeys_t *self) {
       line += 7;
       line += strspn(line, ws);
       line[strcspn(line, ws)] = '\0';
-      self->timeout = (unsigned int)atoi(line);
+      config->timeout = (unsigned int)atoi(line);
       continue;
     }
 
@@ -296,9 +408,35 @@ void xc_parse_config(XChainKeys_t *self) {
       line[strcspn(line, ws)] = '\0';
 
       if(strcmp(line, "off") == 0)
-	feedback = False;
+	config->feedback = False;
       if(strcmp(line, "on") == 0)
-        feedback = True;
+        config->feedback = True;
+
+      continue;
+    }
+
+    if( strncmp(line, "modifiers", 9) == 0 ) {
+      line += 9;
+      line += strspn(line, ws);
+      line[strcspn(line, ws)] = '\0';
+
+      if(strcmp(line, "event") == 0)
+	config->query_modifiers = False;
+      if(strcmp(line, "query") == 0)
+	config->query_modifiers = True;
+
+      continue;
+    }
+
+    if( strncmp(line, "compile", 7) == 0 ) {
+      line += 7;
+      line += strspn(line, ws);
+      line[strcspn(line, ws)] = '\0';
+
+      if(strcmp(line, "off") == 0)
+	config->compile = False;
+      if(strcmp(line, "on") == 0)
+        config->compile = True;
 
       continue;
     }
@@ -307,7 +445,7 @@ void xc_parse_config(XChainKeys_t *self) {
       line += 5;
       line += strspn(line, ws);
       line[strcspn(line, ws)] = '\0';
-      self->delay = (unsigned int)atoi(line);
+      config->delay = (unsigned int)atoi(line);
       continue;
     }
 
@@ -315,15 +453,14 @@ void xc_parse_config(XChainKeys_t *self) {
       line += 4;
       line += strspn(line, ws);
       line[strcspn(line, ws)] = '\0';
-      self->hold = (unsigned int)atoi(line);
+      config->hold = (unsigned int)atoi(line);
       continue;
     }
 
     if( strncmp(line, "position", 8) == 0 ) {
       line += 8;
       line += strspn(line, ws);
-      self->position = (char *) calloc(strlen(line)+1, sizeof(char));
-      self->position = strncpy(self->position, line, strlen(line));
+      strncpy(config->position, line, sizeof(config->position) - 1);
       continue;
     }
 
@@ -331,8 +468,7 @@ void xc_parse_config(XChainKeys_t *self) {
       line += 4;
       line += strspn(line, ws);
       line[strcspn(line, ws)] = '\0';
-      strncpy(font, line, 512);
-      font[strlen(line)] = '\0';
+      strncpy(config->font, line, sizeof(config->font) - 1);
       continue;
     }
 
@@ -340,8 +476,7 @@ void xc_parse_config(XChainKeys_t *self) {
       line += 10;
       line += strspn(line, ws);
       line[strcspn(line, ws)] = '\0';
-      strncpy(fg, line, 64);
-      fg[strlen(line)] = '\0';
+      strncpy(config->fg, line, sizeof(config->fg) - 1);
       continue;
     }
 
@@ -349,24 +484,24 @@ void xc_parse_config(XChainKeys_t *self) {
       line += 10;
       line += strspn(line, ws);
       line[strcspn(line, ws)] = '\0';
-      strncpy(bg, line, 64);
-      bg[strlen(line)] = '\0';
+      strncpy(config->bg, line, sizeof(config->bg) - 1);
       continue;
     }
 
     /* parse bindings */
 
     pos = 0;
-    parent = xc->root;
+    parent = root;
     binding = NULL;
     expect = "key";
+    argument = argument_ptr;
     argument[0] = '\0';
 
     while(strlen(line)) {
       len = strcspn(line, ws);
       
-      token = calloc((len+1), sizeof(char));
       strncpy(token, line, len);
+      token[len] = '\0';
 
       line += strcspn(line, ws);
       line += strspn(line, ws);
@@ -375,7 +510,9 @@ void xc_parse_config(XChainKeys_t *self) {
 	expect = "action";
 
       if (strcmp(expect, "key") == 0) {
-	if ((key = key_new(token)) != NULL) {
+	key = (Key_t *) arena_alloc(arena, sizeof(Key_t));
+
+	if (key_parse_keyspec(key, token)) {
 
 	  /* if this key is already bound in the parent binding,
 	   * then make that binding the parent binding for the next key
@@ -388,20 +525,18 @@ void xc_parse_config(XChainKeys_t *self) {
 	      fprintf(stderr, "%s: line %d: '%s': already bound, skipping...\n",
 		      PACKAGE_NAME, linenum, path);
 	      fflush(stderr);
+	      config->errors++;
 	      free(path);
-	      free(key);
-	      free(token);
 	      goto next_line;
 	    }
 	    else {
-	      parent = binding_get_child_by_key(parent, key);
-	      free(key);
+	      parent = existing;
 	      goto next_token;
 	    }
 	  }
 	  
 	  /* avoid binding :abort, :escape or :group at toplevel */
-	  if(parent == xc->root) {
+	  if(parent == root) {
 	    if(strncmp(line, ":abort", 6) == 0 ||
 	       strncmp(line, ":escape", 7) == 0 ||
 	       strncmp(line, ":group", 6) == 0 ) {
@@ -410,18 +545,17 @@ void xc_parse_config(XChainKeys_t *self) {
 		      "action is invalid outside of chain, skipping...\n",
 		      PACKAGE_NAME, linenum, line); 
 	      fflush(stderr);
-	      free(key);
-	      free(token);
+	      config->errors++;
 	      goto next_line;
 	    }
 	  }
 
 	  /* create a binding for this key */
-	  binding = binding_new();
+	  binding = binding_new(arena);
 	  binding->key = key;
 
 	  /* append the new binding to the current parent */
-	  binding_append_child(parent, binding);
+	  binding_append_child(parent, binding, arena);
 
 	  /* make this binding the parent for the next */
 	  parent = binding;
@@ -431,7 +565,7 @@ void xc_parse_config(XChainKeys_t *self) {
 		  "%s: line %d: '%s': invalid keyspec, skipping...\n",
 		  PACKAGE_NAME, linenum, token);
 	  fflush(stderr);
-	  free(token);
+	  config->errors++;
 	  goto next_line;
 	}
       }
@@ -443,15 +577,13 @@ void xc_parse_config(XChainKeys_t *self) {
       }
 
       if (strcmp(expect, "argument") == 0) {
-	if(strlen(argument))
-	  strcat(argument, " ");
-	strncat(argument, token, 4096-strlen(argument)-1);
+	len = strlen(argument);
+	snprintf(argument + len, 4096 - len, (len > 0) ? " %s" : "%s", token);
 	goto next_token;
       }
 
     next_token:
       pos++;
-      free(token);
     }
     /* all tokens parsed */
     
@@ -466,18 +598,18 @@ void xc_parse_config(XChainKeys_t *self) {
 		  "for action name, ignoring arguments...\n",
 		  PACKAGE_NAME, linenum);
 	  fflush(stderr);
+	  config->errors++;
 	  goto next_line;
 	}
         len = strcspn(argument, "\"");
-	strncpy(binding->name, argument, 128);
-	binding->name[len] = '\0';
+	binding->name = arena_strndup(arena, argument, len);
 	argument += len + 1;
 	argument += strspn(argument, ws);
       }
 
       /* append the argument to the current binding */
       if (strlen(argument)) {
-	strncpy(binding->argument, argument, 4096);
+	binding->argument = arena_strdup(arena, argument);
       }
       argument = argument_ptr;
     }
@@ -486,26 +618,108 @@ void xc_parse_config(XChainKeys_t *self) {
   }
   fclose(f);
   
-  binding_parse_arguments(self->root);
-  binding_create_default_bindings(self->root);
+  binding_parse_arguments(root, arena, config->timeout);
+  binding_create_default_bindings(root, arena);
+  binding_compute_paths(root, arena);
+
+  config->arena = arena;
+  config->root = root;
+  config->usec = get_usec() - start;
+
+  free(buffer);
+  free(argument_ptr);
+
+  return True;
+}
+
+void xc_resolve_config(XChainKeys_t *self, Config_t *config) {
+
+  /* look up the keycodes of the new bindings in the current keyboard
+   * mapping, which xc_read_config() can't do on the reload thread, and
+   * count the keys that turn out to be bound twice as errors */
+  binding_resolve_keys(config->root);
+  config->errors += binding_remove_duplicates(config->root);
+}
+
+void xc_apply_config(XChainKeys_t *self, Config_t *config) {
+  Arena_t *arena;
+  int changes;
+
+  /* look up the counters of the new bindings' paths */
+  binding_attach_stats(config->root, self->stats);
+
+  /* compare the new bindings to the running ones, which carries the
+   * state of the unchanged ones over */
+  if(self->root != NULL)
+    changes = binding_diff(config->root, self->root);
+  else
+    changes = binding_count(config->root) - 1;
+
+  self->timeout = config->timeout;
+  self->delay = config->delay;
+  self->hold = config->hold;
+  self->query_modifiers = config->query_modifiers;
+
+  if(self->root == NULL || changes > 0 || config->compile != self->compile) {
+
+    /* replace the previous generation of bindings. Keys are only
+     * handled between reloads, so none of them sees a mix of both */
+    arena = self->arena;
+    self->arena = config->arena;
+    self->root = config->root;
+    self->compile = config->compile;
+
+    xc_compile(self);
+    xc_build_dispatch(self);
+    grab_set_invalidate(self->grabs);
+  }
+  else {
+    /* keep running the old bindings, their dispatch table, automaton
+     * and grabs stay as they are */
+    arena = config->arena;
+  }
+  config->arena = NULL;
+  arena_free(arena);
+
+  log_printf(self->log, LOG_LEVEL_INFO, 
+	     "%d bindings added, changed or removed\n", changes);
+
+  /* the popup window and its font are kept unless their settings
+   * changed */
+  if(self->popup != NULL && 
+     !popup_matches(self->popup, config->font, config->fg, config->bg)) {
+    popup_free(self->popup);
+    self->popup = NULL;
+  }
+
+  free(self->position);
+  self->position = strdup(config->position);
+
+  if(self->popup == NULL)
+    self->popup = popup_new(self->display, config->font, config->fg,
+			    config->bg, self->position);
 
-  /* initialize popup window */
-  self->popup = popup_new(self->display, font, fg, bg, self->position);
-  self->popup->enabled = feedback;
+  self->popup->position = self->position;
+  self->popup->enabled = config->feedback;
+
+  /* display settings and chains on stdout, which is too much for the
+   * log buffer, after the messages logged so far */
+  if (self->log->level >= LOG_LEVEL_DEBUG) {
+    log_flush(self->log);
 
-  /* display settings and chains on stdout */
-  if (self->debug) {
     printf("\n");
     printf("timeout %d\n", self->timeout);
+    printf("modifiers %s\n", self->query_modifiers ? "query" : "event");
+    printf("compile %s\n", self->compile ? "on" : "off");
 
-    if (feedback) { 
+    if (config->feedback) { 
       printf("feedback on\n");
       printf("delay %d\n", self->delay);
       printf("hold %d\n", self->hold);
       printf("position %s\n", self->position);
-      printf("font %s\n", font);
-      printf("foreground %s\n", fg);
-      printf("background %s\n\n", bg);
+      printf("font %s\n", config->font);
+      printf("foreground %s\n", config->fg);
+      printf("background %s\n\n", config->bg);
     }
     else {
       printf("feedback off\n\n");
@@ -513,20 +727,111 @@ void xc_parse_config(XChainKeys_t *self) {
     
     binding_list(self->root);
     printf("\n");
+    printf("%d bindings, %lu bytes, parsed in %.3f ms\n\n", 
+	   binding_count(self->root) - 1, 
+	   (unsigned long) binding_size(self->root),
+	   config->usec / 1000.0);
+    printf("arena: %lu allocations, %lu blocks, %lu bytes used, "
+	   "%lu bytes reserved\n\n",
+	   self->arena->num_allocs, self->arena->num_blocks,
+	   (unsigned long) self->arena->bytes_used, 
+	   (unsigned long) self->arena->bytes_reserved);
+
+    if (self->automaton != NULL) {
+      printf("automaton: %d states, %d transitions, %lu bytes\n\n",
+	     self->automaton->num_states, self->automaton->num_transitions,
+	     (unsigned long) automaton_size(self->automaton));
+    }
     fflush(stdout);
   }
-  free(buffer);
-  free(argument);
-  free(font);
-  free(fg);
-  free(bg);
+  xc_free_config(config);
+}
+
+void xc_compile(XChainKeys_t *self) {
+
+  /* compile the binding tree into a flat transition table used to
+   * dispatch keys within chains. The tree is used directly if
+   * compilation is turned off. */
+
+  automaton_free(self->automaton);
+  self->automaton = NULL;
+
+  if(self->compile)
+    self->automaton = automaton_new(self->root);
 }
 
 void xc_grab_prefix_keys(XChainKeys_t *self) {
-  /* grab top level keys individually */
+  /* grab top level keys, touching only those that changed since the
+   * last call */
+  grab_set_sync(self->grabs, self->root);
+}
+
+void xc_build_dispatch(XChainKeys_t *self) {
+
+  /* compile the top level keys into a table indexed by keycode and
+   * modifiers, so that the first key of a chain is found with a
+   * single lookup. Rows are only allocated for keycodes that are
+   * actually bound. */
+
+  Binding_t *binding;
+  unsigned int keycode;
+  unsigned int modifiers;
   int i;
-  for (i=0; i<self->root->num_children; i++) {
-    key_grab(self->root->children[i]->key);    
+
+  xc_clear_dispatch(self);
+
+  for( i=0; i<self->root->num_children; i++ ) {
+    binding = self->root->children[i];
+    keycode = key_get_keycode(binding->key);
+    modifiers = binding->key->modifiers & XC_MODIFIERS;
+
+    if(keycode == 0 || keycode > 255)
+      continue;
+
+    if(self->dispatch[keycode] == NULL)
+      self->dispatch[keycode] = 
+	(Binding_t **) calloc(XC_MODIFIERS+1, sizeof(Binding_t *));
+
+    /* the first binding wins, as with the linear search before */
+    if(self->dispatch[keycode][modifiers] == NULL)
+      self->dispatch[keycode][modifiers] = binding;
+  }
+}
+
+void xc_clear_dispatch(XChainKeys_t *self) {
+  int i;
+  for( i=0; i<256; i++ ) {
+    free(self->dispatch[i]);
+    self->dispatch[i] = NULL;
+  }
+}
+
+Binding_t *xc_lookup_prefix(XChainKeys_t *self, unsigned int keycode,
+			    unsigned int modifiers) {
+  if(keycode > 255 || self->dispatch[keycode] == NULL)
+    return NULL;
+  return self->dispatch[keycode][modifiers & XC_MODIFIERS];
+}
+
+void xc_refresh_mapping(XChainKeys_t *self, XMappingEvent *event) {
+
+  /* the keyboard or modifier mapping has changed: update Xlib's
+   * cached mapping, our copy of the modifier map and the lock
+   * modifier combinations, then schedule a resync of the grabs */
+
+  backend_refresh_keyboard_mapping(event);
+
+  if(event->request == MappingModifier) {
+    XFreeModifiermap(self->xmodmap);
+    self->xmodmap = backend_get_modifier_mapping(self->display);
+    xc_init_modmask(self);
+  }
+
+  if(event->request != MappingPointer) {
+    binding_resolve_keys(self->root);
+    xc_compile(self);
+    xc_build_dispatch(self);
+    grab_set_invalidate(self->grabs);
   }
 }
 
@@ -535,83 +840,164 @@ void xc_mainloop(XChainKeys_t *self) {
   Binding_t *reentry;
   XEvent event;
   KeyCode keycode;
-  struct timeval tv;
-  fd_set in;
-  int i;
+  unsigned long serial;
+  unsigned long round_trips;
+  int events;
+  int activations;
 
-  while(True) {
-    xc_grab_prefix_keys(self);
+  launcher_init();
+  launcher_add_to_loop(self->loop);
+  xc_grab_prefix_keys(self);
 
-    if (xc->popup->timeout > 0) {
+  while(True) {
 
-        FD_ZERO(&in);
-        FD_SET(xc->connection, &in);
-        tv.tv_sec = xc->popup->timeout / 1000;
-        tv.tv_usec = (xc->popup->timeout % 1000) * 1000;
-        if (!select(xc->connection + 1, &in, 0, 0, &tv)) {
-            popup_hide(xc->popup);
-            xc->popup->timeout = 0;
-        }
-    }
+    /* wait for the next event, the popup is hidden by its timer and
+     * exited commands are accounted for in the meantime */
+    while (!events_pending(self->display) && 
+	   !reload_ready(self->reloader))
+      loop_wait(self->loop);
+
+    /* remember the request serial and round trips to count those
+     * issued while handling the events of this wakeup */
+    serial = NextRequest(self->display);
+    round_trips = backend_round_trips();
+    events = 0;
+    activations = 0;
+
+    /* handle every event Xlib has read so far before syncing the
+     * grabs and going back to sleep */
+    while (backend_events_queued(self->display) > 0) {
+
+      backend_next_event(self->display, &event);
+      self->event_usec = get_usec();
+      self->repeat = is_autorepeat(&event);
+      self->stats->events++;
+      events++;
+
+      if (event.type == MappingNotify) {
+	xc_refresh_mapping(self, &event.xmapping);
+      }
 
-    XNextEvent(self->display, &event);
+      if (event.type == KeyPress) {
+	keycode = ((XKeyPressedEvent*)&event)->keycode;
+	binding = xc_lookup_prefix(self, keycode,
+				   get_event_modifiers(&event.xkey));
 
-    if (event.type == KeyPress) {
-      keycode = ((XKeyPressedEvent*)&event)->keycode;
-      
-      for( i=0; i<self->root->num_children; i++ ) {
-	binding = self->root->children[i];
-	
-	if (key_get_keycode(binding->key) == keycode) {
-	  if(binding->key->modifiers == get_modifiers(xc->display)) {
-
-	    popup_hide(xc->popup);
-	    xc->popup->timeout = 0;
-	    
-	    binding_activate(binding);
-	    break;
-	  }
+	if (binding != NULL) {
+	  popup_hide(xc->popup);
+	  loop_disarm(self->loop, self->hold_timer);
+	  
+	  xc->unwind = False;
+	  activations++;
+	  binding_activate(binding);
 	}
       }
-    }
-  reentry:
-    if(xc->reentry != NULL) {
-      reentry = xc->reentry;
-      xc->reentry = NULL;
-      binding_activate(reentry);
-      goto reentry;
+    reentry:
+      if(xc->reentry != NULL) {
+	reentry = xc->reentry;
+	xc->reentry = NULL;
+	xc->unwind = False;
+	activations++;
+	binding_activate(reentry);
+	goto reentry;
+      }
+
+      if(xc->reload) {
+	xc_reload(self);
+      }
     }
 
-    if(xc->reload) {
-      xc_reload(self);
+    /* all chains are left and no key is being handled, a safe point
+     * to swap in bindings parsed in the background */
+    if(reload_ready(self->reloader)) {
+      xc_swap_config(self);
+
+      if(xc->reload)
+	xc_reload(self);
     }
+
+    xc_grab_prefix_keys(self);
+
+    log_printf(self->log, LOG_LEVEL_DEBUG, "%d events, %d activations: "
+	       "%lu X requests, %lu round trips (%s)\n", events, activations,
+	       NextRequest(self->display) - serial,
+	       backend_round_trips() - round_trips, backend_name());
   }
 }
 
 void xc_reset(XChainKeys_t *self) {
-  int i;
-  Binding_t *prefix;
 
-  for(i=0; i<self->root->num_children; i++) {
-    prefix = self->root->children[i];
+  /* the binding tree is replaced by xc_apply_config() if anything in
+   * it changed, and the prefix keys stay grabbed until
+   * xc_grab_prefix_keys() finds them gone from the new configuration */
+
+  self->reentry = NULL;
+
+  loop_disarm(self->loop, self->delay_timer);
+  loop_disarm(self->loop, self->hold_timer);
 
-    key_ungrab(prefix->key);
-    binding_free(prefix);
-    self->root->children[i] = NULL;
+  /* the popup is kept, don't leave its text pointing into bindings
+   * that are about to be freed */
+  if(self->popup != NULL) {
+    if(self->popup->mapped)
+      popup_hide(self->popup);
+    self->popup->buffer[0] = '\0';
+    self->popup->text = self->popup->buffer;
   }
-  self->root->num_children = 0;
+}
+
+void xc_reload(XChainKeys_t *self) {  
+  Config_t *config;
+
+  /* a reload requested while another one is parsing is started once
+   * that one is swapped in */
+  if(reload_busy(self->reloader))
+    return;
 
-  self->reentry = NULL;
   self->reload = False;
+  self->stats->reloads++;
+
+  config = xc_new_config(self);
+
+  log_printf(self->log, LOG_LEVEL_INFO, 
+	     "Parsing config file %s in the background\n", config->file);
 
-  popup_free(self->popup);
-  self->popup = NULL;
+  /* parse the config file on a worker thread, the running bindings
+   * keep handling keys until xc_mainloop() calls xc_swap_config() */
+  if(!reload_start(self->reloader, config)) {
+    xc_free_config(config);
+  }
 }
 
-void xc_reload(XChainKeys_t *self) {  
+void xc_swap_config(XChainKeys_t *self) {
+  Config_t *config;
+  int ok;
+
+  if((config = reload_take(self->reloader, &ok)) == NULL)
+    return;
+
+  if(ok)
+    xc_resolve_config(self, config);
+
+  /* keep the running configuration unless the new one is flawless,
+   * unlike at startup, where invalid lines are just skipped */
+  if(!ok || config->errors > 0) {
+    if(ok) {
+      fprintf(stderr, "%s: error: '%s': %d errors, "
+	      "keeping the running configuration\n", 
+	      PACKAGE_NAME, config->file, config->errors);
+    }
+    else {
+      fprintf(stderr, "%s: error: keeping the running configuration\n", 
+	      PACKAGE_NAME);
+    }
+    fflush(stderr);
+    xc_free_config(config);
+    return;
+  }
+
   xc_reset(self);
-  xc_parse_config(self);
-  xc_grab_prefix_keys(self);
+  xc_apply_config(self, config);
 }
 
 void xc_parse_options(XChainKeys_t *self, int argc, char **argv) {
@@ -622,13 +1008,17 @@ void xc_parse_options(XChainKeys_t *self, int argc, char **argv) {
     { "version", no_argument, NULL, 'v' },
     { "keys", no_argument, NULL, 'k' },
     { "file", no_argument, NULL, 'f' },
+    { "launcher", no_argument, NULL, 'l' },
+    { "socket", required_argument, NULL, 's' },
+    { "log-level", required_argument, NULL, 'L' },
+    { "trace", required_argument, NULL, 't' },
     { 0, 0, 0, 0 },
   };
   int option, option_index;
 
   while (1) {
 
-    option = getopt_long(argc, argv, "dhvkf:", options, &option_index);
+    option = getopt_long(argc, argv, "dhvkf:ls:L:t:", options, &option_index);
     
     switch (option) {
 
@@ -638,14 +1028,39 @@ void xc_parse_options(XChainKeys_t *self, int argc, char **argv) {
       break;      
 
     case 'k':
-      xc_show_keys(self);
-      exit(EXIT_SUCCESS);
+      self->show_keys = True;
+      break;
+
+    case 'l':
+      self->launcher = True;
+      break;
+
+    case 's':
+      self->socket = optarg;
+      break;
 
     case 'd':
-      self->debug = True;
+      self->log->level = LOG_LEVEL_DEBUG;
       version();
       printf("\n"); fflush(stdout);
       break;
+
+    case 'L':
+      if ((self->log->level = log_parse_level(optarg)) == -1) {
+	fprintf(stderr, "%s: error: invalid log level '%s'\n", 
+		PACKAGE_NAME, optarg);
+	fflush(stderr);
+	exit(EXIT_FAILURE);
+      }
+      break;
+
+    case 't':
+      if (!log_open_trace(self->log, optarg))
+	exit(EXIT_FAILURE);
+
+      if (self->log->level == LOG_LEVEL_QUIET)
+	self->log->level = LOG_LEVEL_DEBUG;
+      break;
       
     case 'h':
       usage();
@@ -670,13 +1085,9 @@ void xc_parse_options(XChainKeys_t *self, int argc, char **argv) {
   }  
 }
 
-int main(int argc, char **argv) {
-
-  xc = xc_new();
-
-  xc_parse_options(xc, argc, argv);
-  xc_parse_config(xc);
-  xc_mainloop(xc);
+void xc_dump(XChainKeys_t *self, FILE *file) {
 
-  exit(EXIT_SUCCESS);
+  /* the statistics shown on SIGUSR1 and sent to the control socket */
+  stats_dump(self->stats, file);
+  launcher_dump(file);
 }
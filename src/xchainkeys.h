@@ -14,35 +14,94 @@
 #define XC_ABORT_AUTO 1
 #define XC_ABORT_MANUAL 0
 
+/* Shift, Lock, Control and Mod1-Mod5 */
+#define XC_MODIFIERS 0xff
+
+/* the bindings and settings read from a config file, built next to
+ * the running ones and swapped in as a whole by xc_apply_config() */
+typedef struct Config {
+  char file[4096];
+  int errors;
+  struct Arena *arena;
+  struct Binding *root;
+  unsigned int timeout;
+  unsigned int delay;
+  unsigned int hold;
+  int query_modifiers;
+  int compile;
+  int feedback;
+  char position[512];
+  char font[512];
+  char fg[64];
+  char bg[64];
+  long usec;
+} Config_t;
+
 typedef struct XChainKeys {
   Display *display;
   XModifierKeymap *xmodmap;
+  unsigned int modifier_table[256];
   int modmask[8];
+  unsigned int lockmask;
+  int query_modifiers;
   char *action_names[XC_NUM_ACTIONS];
-  int debug;
+  struct Log *log;
+  int show_keys;
+  int launcher;
   unsigned int timeout;
   unsigned int delay;
   unsigned int hold;
   int connection;
+  long event_usec;
+  XKeyEvent last_key;
+  int repeat;
   char *position;
   char *config;
   int reload;
   struct Popup *popup;
+  struct Loop *loop;
+  struct LoopTimer *delay_timer;
+  struct LoopTimer *hold_timer;
+  struct GrabSet *grabs;
+  struct Stats *stats;
+  char *socket;
+  struct Reload *reloader;
+  struct Binding **dispatch[256];
+  struct Arena *arena;
   struct Binding *root;
+  struct Automaton *automaton;
+  int compile;
   struct Binding *reentry;
+  int unwind;
 } XChainKeys_t;
 
 XChainKeys_t* xc_new(void);
+void xc_open_display(XChainKeys_t *self);
+void xc_show_popup(struct LoopTimer *timer, void *data);
+void xc_hide_popup(struct LoopTimer *timer, void *data);
 void xc_parse_options(XChainKeys_t *self, int argc, char **argv);
 void xc_init_modmask(XChainKeys_t *self);
 int xc_handle_error(Display *display, XErrorEvent *event);
 void xc_show_keys(XChainKeys_t *self);
 void xc_find_config(XChainKeys_t *self);
 void xc_parse_config(XChainKeys_t *self);
+Config_t *xc_new_config(XChainKeys_t *self);
+int xc_read_config(Config_t *config);
+void xc_resolve_config(XChainKeys_t *self, Config_t *config);
+void xc_apply_config(XChainKeys_t *self, Config_t *config);
+void xc_free_config(Config_t *config);
+void xc_compile(XChainKeys_t *self);
 void xc_grab_prefix_keys(XChainKeys_t *self);
+void xc_build_dispatch(XChainKeys_t *self);
+void xc_clear_dispatch(XChainKeys_t *self);
+struct Binding *xc_lookup_prefix(XChainKeys_t *self, unsigned int keycode,
+				 unsigned int modifiers);
+void xc_refresh_mapping(XChainKeys_t *self, XMappingEvent *event);
 void xc_mainloop(XChainKeys_t *self);
 void xc_reload(XChainKeys_t *self);
+void xc_swap_config(XChainKeys_t *self);
 void xc_reset(XChainKeys_t *self);
+void xc_dump(XChainKeys_t *self, FILE *file);
 void xc_shutdown(XChainKeys_t *self);
 
 #endif /* ifndef XCHAINKEYS_H */